@@ -0,0 +1,3806 @@
+/**
+
+   Library: libsugpass
+
+   Created by Simon Rowe <simon@wiremoons.com>
+
+   Updated 17 Oct 2026 - password generation split out of sugpass.c
+   into this library so it can be used in process by other programs.
+
+   About
+
+   The password generation core of 'sugpass' - see libsugpass.h for
+   the functions provided and how to use them.
+
+   Nothing here prints or exits: errors are returned as -1 with a
+   message put in the context for sugError(). All generation state is
+   held in the context - the only globals are the built in words, the
+   '--stats' totals and the count of bytes allocated.
+
+   Build with: 'make lib' - or compile in with sugpass.c as the
+   provided 'Makefile' does.
+
+   The library is licensed under the "MIT License" see
+   http://opensource.org/licenses/MIT for more details.
+
+*/
+
+#ifdef _WIN32
+#define _CRT_RAND_S   // required before <stdlib.h> to declare rand_s()
+#endif
+#define SUGPASS_INTERNAL
+#include "libsugpass.h"
+#include <stdio.h>	  // for snprintf() fopen()
+#include <stdlib.h>	  // for use of rand() malloc()
+#include <stdarg.h>	  // used for va_list in setError()
+#include <string.h>	  // used for memcpy() strlen()
+#include <unistd.h>	  // used for close() read()
+#include <math.h>	  // used for log2()
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h> // used for SSSE3 and AVX2 password assembly
+#endif
+#include <ctype.h>	  // used for isdigit()
+#include <errno.h>	  // used for strerror()
+#include <pthread.h>  // used for the stats and hash locks
+#include <fcntl.h>    // used for open() of word list files
+#include <sys/stat.h> // used for fstat() to get word list file size
+#ifndef _WIN32
+#include <sys/mman.h> // used for mmap() of word list files
+#endif
+#if defined(__linux__)
+#include <sys/random.h>   // used for getrandom()
+#endif
+
+/*-----------------------*/
+/* SET GLOBAL VARIABLES  */
+/*-----------------------*/
+
+/* control if the '--stats' timers are read (0 == off; 1 == on;) */
+int statsOn = 0;
+/* this thread's stats counters - and the totals of all threads */
+_Thread_local runStats threadStats;
+static runStats totalStats;
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+/* memory allocated by sugMalloc() - reported by the benchmarks */
+static _Atomic unsigned long long allocBytes = 0;
+/*
+	the built in words. sugwords.h is made by 'mkwords' from
+	English-Three-Letter-Word-List.txt when 'make' is run: 'words' is a
+	table of fixed four byte entries, each a three letter word and its
+	NUL - so the table is one dense block of memory, used directly as
+	the built in dictionary - along with the word count, the entropy of
+	a word, a first letter index and the wordHash of the words. So the
+	built in dictionary is complete at compile time. mkwords itself is
+	built with a one word stand in, as it makes the header.
+*/
+#ifndef SUGPASS_MKWORDS
+#include "sugwords.h"
+#else
+#define SUGWORDS_COUNT 1
+#define SUGWORDS_BITS 0.0
+const char words[SUGWORDS_COUNT][WORD_STRIDE] = { "aah" };
+const uint16_t wordLetterStart[27] = { 0, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1 };
+#define SUGWORDS_HASH_SEED 0ULL
+#define SUGWORDS_HASH_BUCKETS 1
+static const uint32_t sugWordsPilot[SUGWORDS_HASH_BUCKETS] = { 0 };
+static const uint32_t sugWordsSlot[SUGWORDS_COUNT] = { 0 };
+#endif
+
+/* number of words in the built in words[] table */
+const int wordArraySize = SUGWORDS_COUNT;
+
+/* the built in dictionary - it is only read, so the casts are safe */
+static wordHash builtinHash = {
+	.seed = SUGWORDS_HASH_SEED,
+	.buckets = SUGWORDS_HASH_BUCKETS,
+	.pilot = (uint32_t *)sugWordsPilot,
+	.slot = (uint32_t *)sugWordsSlot };
+static wordDict builtinDict = {
+	.data = (char *)words,
+	.count = SUGWORDS_COUNT,
+	.wordLen = WORD_LEN,
+	.stride = WORD_STRIDE,
+	.maxLen = WORD_LEN,
+	.bits = SUGWORDS_BITS,
+	.hash = &builtinHash };
+
+
+/**-------- FUNCTION: setError
+
+   put the printf() style message 'fmt' into the error buffer 'err'
+   (SUG_ERR_LEN bytes) - returns -1 so failures can end with:
+   return setError(...)
+
+*/
+
+static int setError(char *err, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(err, SUG_ERR_LEN, fmt, ap);
+	va_end(ap);
+	return -1;
+}
+
+/**-------- FUNCTION: sugMalloc
+
+   allocate 'size' bytes with malloc() - counting the bytes allocated,
+   for the benchmarks to report. Returns NULL if the memory is not
+   available.
+
+*/
+
+void *sugMalloc(size_t size)
+{
+	void *p = malloc(size > 0 ? size : 1);
+	if (p != NULL) atomic_fetch_add_explicit(&allocBytes, size, memory_order_relaxed);
+	return p;
+}
+
+unsigned long long sugAllocatedBytes(void)
+{
+	return atomic_load(&allocBytes);
+}
+
+/**-------- FUNCTION: sugStatsEnable / sugStatsMerge / sugStatsGet
+
+   turn the '--stats' timers on or off. Add this thread's stats to the
+   totals - and clear them, so they are never added twice - which is
+   done as each thread finishes. Copy out the totals.
+
+*/
+
+void sugStatsEnable(int on)
+{
+	statsOn = on;
+}
+
+void sugStatsMerge(void)
+{
+	pthread_mutex_lock(&statsLock);
+	uint64_t *from = (uint64_t *)&threadStats;
+	uint64_t *to = (uint64_t *)&totalStats;
+	for (size_t i = 0; i < sizeof(runStats)/sizeof(uint64_t); i++) to[i] += from[i];
+	pthread_mutex_unlock(&statsLock);
+	memset(&threadStats, 0, sizeof(threadStats));
+}
+
+void sugStatsGet(runStats *out)
+{
+	pthread_mutex_lock(&statsLock);
+	*out = totalStats;
+	pthread_mutex_unlock(&statsLock);
+}
+
+/**-------- FUNCTION: getEntropy
+
+   fill 'buf' with 'len' bytes of random data from the operating
+   system - used to seed the random engines. Returns -1 if no random
+   data can be obtained, as a weak seed is worse than none.
+
+*/
+
+int getEntropy(void *buf, size_t len)
+{
+	unsigned char *p = buf;
+#if defined(__linux__)
+	while (len > 0)
+	{
+		ssize_t got = getrandom(p, len, 0);
+		if (got < 0)
+		{
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		p += got;
+		len -= (size_t)got;
+	}
+#elif defined(_WIN32)
+	while (len > 0)
+	{
+		unsigned int r;
+		if (rand_s(&r) != 0) return -1;
+		size_t n = len < sizeof(r) ? len : sizeof(r);
+		memcpy(p, &r, n);
+		p += n;
+		len -= n;
+	}
+#else
+	FILE *fp = fopen("/dev/urandom","rb");
+	if (fp == NULL) return -1;
+	size_t got = fread(p, 1, len, fp);
+	fclose(fp);
+	if (got != len) return -1;
+#endif
+	return 0;
+}
+
+/**-------- FUNCTION: chachaBlock
+
+   compute one 64 byte ChaCha20 block (RFC 7539 rounds, with the
+   original 64 bit block counter and 64 bit nonce layout) for the key,
+   counter and nonce provided, and store it in 'out'
+
+*/
+
+#define ROTL32(v,n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QROUND(a,b,c,d) \
+	a += b; d ^= a; d = ROTL32(d,16); \
+	c += d; b ^= c; b = ROTL32(b,12); \
+	a += b; d ^= a; d = ROTL32(d, 8); \
+	c += d; b ^= c; b = ROTL32(b, 7);
+
+void chachaBlock(const uint32_t key[8], uint64_t counter, uint64_t nonce, uint32_t out[16])
+{
+	uint32_t in[16] = {
+		0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,   // "expand 32-byte k"
+		key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+		(uint32_t)counter, (uint32_t)(counter >> 32),
+		(uint32_t)nonce, (uint32_t)(nonce >> 32) };
+	uint32_t x[16];
+	memcpy(x, in, sizeof(x));
+
+	// 20 rounds - as 10 pairs of column and diagonal rounds
+	for (int i = 0; i < 10; i++)
+	{
+		QROUND(x[0], x[4], x[ 8], x[12]);
+		QROUND(x[1], x[5], x[ 9], x[13]);
+		QROUND(x[2], x[6], x[10], x[14]);
+		QROUND(x[3], x[7], x[11], x[15]);
+		QROUND(x[0], x[5], x[10], x[15]);
+		QROUND(x[1], x[6], x[11], x[12]);
+		QROUND(x[2], x[7], x[ 8], x[13]);
+		QROUND(x[3], x[4], x[ 9], x[14]);
+	}
+	for (int i = 0; i < 16; i++) out[i] = x[i] + in[i];
+}
+
+/**-------- FUNCTION: chachaRefill
+
+   refill the engine buffer with the next run of ChaCha20 keystream
+   blocks - the whole buffer is produced in one batch
+
+*/
+
+static void chachaRefill(randEngine *eng)
+{
+	for (size_t b = 0; b < RNG_BUF_WORDS; b += 16)
+	{
+		chachaBlock(eng->key, eng->counter++, eng->nonce, eng->buf+b);
+	}
+	eng->pos = 0;
+}
+
+/**-------- FUNCTION: chachaSeekRefill
+
+   refill for a seeded engine - just one ChaCha20 block, into the end
+   of the buffer. A password needs only a few random values, and each
+   seeded password has its own stream (see rngStartPassword()), so
+   making a whole batch of blocks would waste all but the first.
+
+*/
+
+static void chachaSeekRefill(randEngine *eng)
+{
+	chachaBlock(eng->key, eng->counter++, eng->nonce, eng->buf + RNG_BUF_WORDS - 16);
+	eng->pos = RNG_BUF_WORDS - 16;
+}
+
+/**-------- FUNCTION: libcRefill
+
+   refill the engine buffer using the C library rand() function. This
+   is the legacy engine kept for comparison only - it is NOT suitable
+   for creating real passwords. rand() may only give 15 random bits
+   per call (eg on Windows), so three calls are combined per value.
+   rand() is shared by the whole process, so neither is it reentrant.
+
+*/
+
+static void libcRefill(randEngine *eng)
+{
+	for (size_t i = 0; i < RNG_BUF_WORDS; i++)
+	{
+		eng->buf[i] = ((uint32_t)(rand() & 0x7fff) << 17) ^
+		              ((uint32_t)(rand() & 0x7fff) << 2) ^
+		              ((uint32_t)rand() & 0x3);
+	}
+	eng->pos = 0;
+}
+
+/*
+	table of the random engines available - selected by name with
+	sugSetEngine(). First entry is the default.
+*/
+const engineEntry engineTable[] = {
+	{ "chacha20", chachaRefill },
+	{ "libc",     libcRefill },
+};
+const size_t engineCount = sizeof(engineTable)/sizeof(engineTable[0]);
+
+/**-------- FUNCTION: rngInit
+
+   set up the random engine 'eng' as the engine called 'name', to be
+   seeded from the operating system by rngSeed() before it is first
+   used. Returns -1 with a message in 'err' if the engine name is
+   unknown.
+
+*/
+
+int rngInit(randEngine *eng, const char *name, char *err)
+{
+	size_t i = 0;
+	while (i < engineCount && strcmp(engineTable[i].name, name) != 0) i++;
+	if (i == engineCount)
+	{
+		int n = snprintf(err, SUG_ERR_LEN, "unknown random engine '%s' - choose from:", name);
+		for (i = 0; i < engineCount && n < SUG_ERR_LEN; i++)
+			n += snprintf(err + n, SUG_ERR_LEN - n, " %s", engineTable[i].name);
+		return -1;
+	}
+	randEngine fresh;
+	memset(&fresh, 0, sizeof(fresh));
+	fresh.name = engineTable[i].name;
+	fresh.refill = engineTable[i].refill;
+	fresh.needSeed = 1;
+	// mark the buffer as used up, so first call to rngNext32() refills
+	fresh.pos = RNG_BUF_WORDS;
+	*eng = fresh;
+	return 0;
+}
+
+/**-------- FUNCTION: rngSeed
+
+   seed the engine 'eng' from the operating system if it still needs
+   it. Done when the engine is first used rather than when it is set
+   up, so runs that make no passwords (eg '--decode') never ask for a
+   seed, and each thread's context gets its seed in its own thread.
+   Returns -1 with a message in 'err' if no seed could be obtained.
+
+*/
+
+int rngSeed(randEngine *eng, char *err)
+{
+	if (!eng->needSeed) return 0;
+	// ChaCha20 key and nonce from the OS - counter starts at zero
+	if (getEntropy(eng->key, sizeof(eng->key)) != 0 ||
+		getEntropy(&eng->nonce, sizeof(eng->nonce)) != 0)
+	{
+		return setError(err, "unable to obtain a random seed: %s", strerror(errno));
+	}
+	// the libc engine just uses part of the same seed for srand()
+	if (eng->refill == libcRefill) srand(eng->key[0]);
+	eng->needSeed = 0;
+	return 0;
+}
+
+
+/**-------- FUNCTION: assembleStride4
+
+   assemble 'n' three letter words from the table 'table' of four byte
+   entries (WORD_STRIDE) into a password. 'idx' holds the 'n' word
+   indices. Exactly n * 3 bytes are written to 'plain' and, if 'spaced'
+   is not NULL, n * 4 bytes to 'spaced' - each word followed by a space
+   (so one space more than needed, which the caller overwrites).
+
+   There are three versions, picked by sugSetKernel() for the CPU in
+   use: scalar C for any CPU, SSSE3 doing 4 words at a time and AVX2
+   doing 8 words at a time with a gather load. The SIMD versions load
+   whole table entries, then use a byte shuffle to drop the 4th byte
+   of each for the plain form, or replace that byte with a space for
+   the spaced form.
+
+*/
+
+void assembleStride4Scalar(const char *table, const uint32_t *idx, int n, char *plain, char *spaced)
+{
+	for (int i = 0; i < n; i++)
+	{
+		uint32_t w;
+		memcpy(&w, table + (idx[i] * WORD_STRIDE), WORD_STRIDE);
+		// a 4 byte copy is faster than 3 - the extra byte is overwritten
+		// by the next word, except for the last word
+		if (i < n - 1) memcpy(plain + (i * WORD_LEN), &w, WORD_STRIDE);
+		else memcpy(plain + (i * WORD_LEN), &w, WORD_LEN);
+		if (spaced)
+		{
+			memcpy(spaced + (i * WORD_STRIDE), &w, WORD_STRIDE);
+			spaced[(i * WORD_STRIDE) + WORD_LEN] = ' ';
+		}
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+/* 4th byte of each 32 bit entry cleared, then set to a space */
+#define SPACE_KEEP 0x00ffffff
+#define SPACE_SET  0x20000000
+
+__attribute__((target("ssse3")))
+void assembleStride4SSSE3(const char *table, const uint32_t *idx, int n, char *plain, char *spaced)
+{
+	// byte shuffle to pack 4 words of 4 bytes into the first 12 bytes
+	const __m128i pack = _mm_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+	const __m128i keep = _mm_set1_epi32(SPACE_KEEP);
+	const __m128i space = _mm_set1_epi32(SPACE_SET);
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		uint32_t w0, w1, w2, w3;
+		memcpy(&w0, table + (idx[i]   * WORD_STRIDE), WORD_STRIDE);
+		memcpy(&w1, table + (idx[i+1] * WORD_STRIDE), WORD_STRIDE);
+		memcpy(&w2, table + (idx[i+2] * WORD_STRIDE), WORD_STRIDE);
+		memcpy(&w3, table + (idx[i+3] * WORD_STRIDE), WORD_STRIDE);
+		__m128i v = _mm_setr_epi32(w0, w1, w2, w3);
+		__m128i p = _mm_shuffle_epi8(v, pack);
+		// store exactly 12 bytes: 8 then 4
+		_mm_storel_epi64((__m128i *)(plain + (i * WORD_LEN)), p);
+		uint32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(p, 8));
+		memcpy(plain + (i * WORD_LEN) + 8, &tail, 4);
+		if (spaced)
+		{
+			__m128i s = _mm_or_si128(_mm_and_si128(v, keep), space);
+			_mm_storeu_si128((__m128i *)(spaced + (i * WORD_STRIDE)), s);
+		}
+	}
+	if (i < n) assembleStride4Scalar(table, idx + i, n - i, plain + (i * WORD_LEN),
+		spaced ? spaced + (i * WORD_STRIDE) : NULL);
+}
+
+__attribute__((target("avx2")))
+void assembleStride4AVX2(const char *table, const uint32_t *idx, int n, char *plain, char *spaced)
+{
+	// shuffle works within each 16 byte half - each half packs 4 words
+	const __m256i pack = _mm256_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1,
+	                                      0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+	const __m256i keep = _mm256_set1_epi32(SPACE_KEEP);
+	const __m256i space = _mm256_set1_epi32(SPACE_SET);
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i vi = _mm256_loadu_si256((const __m256i *)(idx + i));
+		__m256i v = _mm256_i32gather_epi32((const int *)table, vi, WORD_STRIDE);
+		__m256i p = _mm256_shuffle_epi8(v, pack);
+		__m128i lo = _mm256_castsi256_si128(p);
+		__m128i hi = _mm256_extracti128_si256(p, 1);
+		// store exactly 24 bytes: the 16 byte store of the low half has 4
+		// bytes of padding which the high half overwrites
+		char *out = plain + (i * WORD_LEN);
+		_mm_storeu_si128((__m128i *)out, lo);
+		_mm_storel_epi64((__m128i *)(out + 12), hi);
+		uint32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+		memcpy(out + 20, &tail, 4);
+		if (spaced)
+		{
+			__m256i s = _mm256_or_si256(_mm256_and_si256(v, keep), space);
+			_mm256_storeu_si256((__m256i *)(spaced + (i * WORD_STRIDE)), s);
+		}
+	}
+	if (i < n) assembleStride4SSSE3(table, idx + i, n - i, plain + (i * WORD_LEN),
+		spaced ? spaced + (i * WORD_STRIDE) : NULL);
+}
+#endif
+
+/*
+	table of the password assembly kernels - selected by name with
+	sugSetKernel(), or the first one the CPU supports
+*/
+const kernelEntry kernelTable[] = {
+#ifdef HAVE_X86_SIMD
+	{ "avx2",   assembleStride4AVX2 },
+	{ "ssse3",  assembleStride4SSSE3 },
+#endif
+	{ "scalar", assembleStride4Scalar },
+};
+const size_t kernelCount = sizeof(kernelTable)/sizeof(kernelTable[0]);
+
+/**-------- FUNCTION: kernelSupported
+
+   check if the CPU in use can run the kernel called 'name'
+
+*/
+
+int kernelSupported(const char *name)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+	if (strcmp(name, "ssse3") == 0) return __builtin_cpu_supports("ssse3");
+#endif
+	return 1;
+}
+
+/**-------- FUNCTION: buildPassword
+
+   build one password of ctx->nWords random words from the context's
+   dictionary - or with the "markov" mode, of ctx->nWords syllables
+   from its markov model - in a single pass.
+
+   The plain form (no spaces) is written to 'plain' and, if 'spaced'
+   is not NULL, the form with a space between each word is written to
+   'spaced' at the same time. No NUL terminators are written. Returns
+   the length of the plain form - the spaced form is always nWords-1
+   characters longer. The caller must provide at least maxPassLength()
+   bytes at 'plain', and nWords more at 'spaced' (the byte after the
+   spaced form may be written to). Nothing is allocated, so the caller
+   owns all the memory used.
+
+   Three letter words in a table of four byte entries (the built in
+   words[]) are assembled in batches by the context's kernel. Other
+   words of a fixed length are fixed size copies - otherwise the
+   lengths come from the offset index. Syllables are made a letter at
+   a time by markovLetters(), carrying the pair on from one to the next.
+
+*/
+
+/* most word indices drawn from the random engine in one batch */
+#define IDX_BATCH 64
+
+size_t maxPassLength(const sugContext *ctx, int nWords)
+{
+	return (size_t)nWords * (ctx->markov ? MARKOV_SYLLABLE : ctx->dict->maxLen);
+}
+
+size_t buildPassword(sugContext *ctx, char *plain, char *spaced)
+{
+	const wordDict *d = ctx->dict;
+	int nWords = ctx->nWords;
+	uint32_t idx[IDX_BATCH];
+	size_t len = 0;
+	STAT_ADD(words, nWords);
+
+	if (ctx->markov)
+	{
+		uint32_t pair = MARKOV_START;
+		STAT_START(ts);
+		for (int w = 0; w < nWords; w++)
+		{
+			markovLetters(ctx->markov, &ctx->eng, &pair, plain + len, MARKOV_SYLLABLE);
+			if (spaced)
+			{
+				memcpy(spaced + len + w, plain + len, MARKOV_SYLLABLE);
+				spaced[len + w + MARKOV_SYLLABLE] = ' ';
+			}
+			len += MARKOV_SYLLABLE;
+		}
+		STAT_STOP(ts, cyclesSelect);
+		return len;
+	}
+
+	for (int x = 0; x < nWords; x += IDX_BATCH)
+	{
+		// select a batch of words - then build that part of the password
+		int n = nWords - x < IDX_BATCH ? nWords - x : IDX_BATCH;
+		STAT_START(ts);
+		selectWords(ctx, idx, n);
+		STAT_STOP(ts, cyclesSelect);
+		STAT_START(tf);
+
+		if (d->wordLen == WORD_LEN && d->stride == WORD_STRIDE)
+		{
+			ctx->assemble(d->data, idx, n, plain + len, spaced ? spaced + len + x : NULL);
+			len += (size_t)n * WORD_LEN;
+		}
+		else if (d->wordLen)
+		{
+			uint32_t wlen = d->wordLen;
+			for (int i = 0; i < n; i++)
+			{
+				const char *w = d->data + ((size_t)idx[i] * d->stride);
+				memcpy(plain + len, w, wlen);
+				if (spaced)
+				{
+					memcpy(spaced + len + x + i, w, wlen);
+					spaced[len + x + i + wlen] = ' ';
+				}
+				len += wlen;
+			}
+		}
+		else
+		{
+			for (int i = 0; i < n; i++)
+			{
+				uint32_t r = idx[i];
+				uint32_t wlen = d->offset[r+1] - d->offset[r];
+				memcpy(plain + len, d->data + d->offset[r], wlen);
+				if (spaced)
+				{
+					memcpy(spaced + len + x + i, d->data + d->offset[r], wlen);
+					spaced[len + x + i + wlen] = ' ';
+				}
+				len += wlen;
+			}
+		}
+		STAT_STOP(tf, cyclesFormat);
+	}
+	return len;
+}
+
+/**-------- FUNCTION: policyActive etc
+
+   small helpers for the password policy 'p':
+	policyActive()     - 1 if passwords need more than buildPassword()
+	addDigit()         - 1 if a digit is added to each password of
+	                     'nWords' words - not if the separator is a
+	                     digit, as long as there are words to separate
+	addSymbol()        - 1 if a symbol is added, in the same way
+	addUpper()         - 1 if one random word is made uppercase
+	policyTokens()     - words plus added digit and symbol
+
+*/
+
+static inline int addDigit(const passPolicy *p, int nWords) { return p->requireDigit && !(nWords > 1 && isdigit((unsigned char)p->separator)); }
+static inline int addSymbol(const passPolicy *p, int nWords) { return p->requireSymbol && !(nWords > 1 && p->separator && strchr(POLICY_SYMBOLS, p->separator)); }
+static inline int addUpper(const passPolicy *p) { return p->requireUpper && !p->capitalise; }
+int policyTokens(const passPolicy *p, int nWords) { return nWords + addDigit(p, nWords) + addSymbol(p, nWords); }
+
+static inline int policyActive(const passPolicy *p)
+{
+	return p->requireDigit || p->requireUpper || p->requireSymbol || p->capitalise || p->separator;
+}
+
+/**-------- FUNCTION: policyMaxLength
+
+   the longest a password of 'nWords' words made with the context 'ctx'
+   can be once its policy is applied - in characters, with no NUL
+
+*/
+
+size_t policyMaxLength(const sugContext *ctx, int nWords)
+{
+	const passPolicy *p = &ctx->policy;
+	int tokens = policyTokens(p, nWords);
+	size_t len = maxPassLength(ctx, nWords) + addDigit(p, nWords) + addSymbol(p, nWords);
+	if (p->separator && tokens > 1) len += tokens - 1;
+	return len;
+}
+
+/**-------- FUNCTION: policyEntropy
+
+   the exact entropy in bits of a password of 'nWords' words made with
+   the context 'ctx' with its policy applied. Each word adds
+   log2(count) - or with the "markov" mode the syllables together add
+   their min-entropy, from markovModel.minBits[]. A digit put at one
+   of the nWords+1 word boundaries adds log2(10 * (nWords+1)), and a
+   symbol put at one of the boundaries left after that adds
+   log2(symbols * boundaries). Making one of the words uppercase adds
+   log2(nWords). Capitalising every word, and the separator, add
+   nothing as they are the same for every password.
+
+*/
+
+double policyEntropy(const sugContext *ctx, int nWords)
+{
+	const passPolicy *p = &ctx->policy;
+	double bits = ctx->markov ? ctx->markov->minBits[nWords] : nWords * ctx->dict->bits;
+	int boundaries = nWords + 1;
+	if (addDigit(p, nWords))
+	{
+		bits += log2(10.0 * boundaries);
+		boundaries++;
+	}
+	if (addSymbol(p, nWords)) bits += log2((double)(sizeof(POLICY_SYMBOLS) - 1) * boundaries);
+	if (addUpper(p) && nWords > 1) bits += log2(nWords);
+	return bits;
+}
+
+/**-------- FUNCTION: applyPolicy
+
+   check the context's policy can be met with its dictionary, and work
+   out how many words are needed. With a minimum entropy the number of
+   words is the fewest that give it (or ctx->wordsFloor if that is
+   more). Returns -1 if the maximum length would not allow that - or
+   if the minimum entropy would need more than POLICY_MAX_WORDS words
+   (MARKOV_MAX_SYLLABLES syllables for a markov password).
+
+*/
+
+/* most words the minimum entropy of a policy can ask for */
+#define POLICY_MAX_WORDS 10000
+
+static int applyPolicy(sugContext *ctx)
+{
+	const passPolicy *p = &ctx->policy;
+	int n = ctx->wordsFloor;
+	int most = ctx->markov ? MARKOV_MAX_SYLLABLES : POLICY_MAX_WORDS;
+	if (p->minEntropy > 0)
+	{
+		if (n < 1) n = 1;
+		while (policyEntropy(ctx, n) < p->minEntropy && n < most) n++;
+	}
+	if ((ctx->markov && n > MARKOV_MAX_SYLLABLES) || policyEntropy(ctx, n) < p->minEntropy)
+	{
+		return setError(ctx->error, "%s passwords can have at most %d %s - %.1f bits of entropy",
+			ctx->markov ? "markov" : "word", most, ctx->markov ? "syllables" : "words", policyEntropy(ctx, most));
+	}
+	if (p->maxLen > 0 && policyMaxLength(ctx, n) > (size_t)p->maxLen)
+	{
+		return setError(ctx->error, "%d words with the policy given can be up to %zu characters - more than --max-len %d",
+			n, policyMaxLength(ctx, n), p->maxLen);
+	}
+	ctx->nWords = n;
+	ctx->failed = 0;
+	return 0;
+}
+
+/**-------- FUNCTION: makePassword
+
+   build one password of ctx->nWords words meeting the context's
+   policy. As buildPassword() - which is used when the policy needs
+   nothing more - but the length of the spaced form (which has a space
+   wherever the plain form has a separator, and between any added
+   digit or symbol and the words) is returned in '*spacedLen'. Memory
+   needed is policyMaxLength() bytes at 'plain' plus policyTokens()
+   more at 'spaced'.
+
+   All the random choices for the policy are made once per password
+   along with the words, so meeting the policy costs a few more random
+   values per password - there is no making and rejecting of passwords.
+
+*/
+
+static size_t makePassword(sugContext *ctx, char *plain, char *spaced, size_t *spacedLen)
+{
+	const wordDict *d = ctx->dict;
+	const passPolicy *p = &ctx->policy;
+	randEngine *eng = &ctx->eng;
+	int nWords = ctx->nWords;
+	STAT_ADD(passwords, 1);
+	if (!policyActive(p))
+	{
+		size_t len = buildPassword(ctx, plain, spaced);
+		*spacedLen = nWords > 0 ? len + nWords - 1 : 0;
+		return len;
+	}
+
+	// choose where the digit, symbol and uppercase word go: the digit is
+	// placed among the words first, and the symbol among the result
+	int hasDigit = addDigit(p, nWords), hasSymbol = addSymbol(p, nWords);
+	int digitPos = hasDigit ? (int)rngUniform(eng, nWords + 1) : -1;
+	char digit = hasDigit ? (char)('0' + rngUniform(eng, 10)) : 0;
+	int symbolPos = hasSymbol ? (int)rngUniform(eng, nWords + 1 + hasDigit) : -1;
+	char symbol = hasSymbol ? POLICY_SYMBOLS[rngUniform(eng, sizeof(POLICY_SYMBOLS) - 1)] : 0;
+	int upperWord = addUpper(p) ? (int)rngUniform(eng, nWords) : -1;
+
+	// words are selected as they are needed here - so all of the policy
+	// path is timed as formatting
+	STAT_ADD(words, nWords);
+	STAT_START(tf);
+	int tokens = nWords + hasDigit + hasSymbol;
+	size_t plen = 0, slen = 0;
+	uint32_t pair = MARKOV_START;
+	char syllable[MARKOV_SYLLABLE];
+	for (int t = 0; t < tokens; t++)
+	{
+		if (t > 0)
+		{
+			if (p->separator) plain[plen++] = p->separator;
+			if (spaced) spaced[slen++] = ' ';
+		}
+		// work back from the token position to what is at it
+		if (t == symbolPos)
+		{
+			plain[plen++] = symbol;
+			if (spaced) spaced[slen++] = symbol;
+			continue;
+		}
+		int t1 = (hasSymbol && t > symbolPos) ? t - 1 : t;
+		if (t1 == digitPos)
+		{
+			plain[plen++] = digit;
+			if (spaced) spaced[slen++] = digit;
+			continue;
+		}
+		int w = (hasDigit && t1 > digitPos) ? t1 - 1 : t1;
+
+		const char *word;
+		uint32_t wlen;
+		if (ctx->markov)
+		{
+			markovLetters(ctx->markov, eng, &pair, syllable, MARKOV_SYLLABLE);
+			word = syllable;
+			wlen = MARKOV_SYLLABLE;
+		}
+		else if (d->wordLen)
+		{
+			uint32_t r;
+			selectWords(ctx, &r, 1);
+			word = d->data + ((size_t)r * d->stride);
+			wlen = d->wordLen;
+		}
+		else
+		{
+			uint32_t r;
+			selectWords(ctx, &r, 1);
+			word = d->data + d->offset[r];
+			wlen = d->offset[r+1] - d->offset[r];
+		}
+		char *out = plain + plen;
+		memcpy(out, word, wlen);
+		if (p->capitalise || w == upperWord) out[0] = toupper((unsigned char)out[0]);
+		if (spaced) memcpy(spaced + slen, out, wlen);
+		plen += wlen;
+		slen += wlen;
+	}
+	STAT_STOP(tf, cyclesFormat);
+	*spacedLen = slen;
+	return plen;
+}
+
+/**-------- FUNCTION: generatePassword
+
+   build one password with makePassword() - and if the context has a
+   blocklist, make another in its place for as long as the password
+   is in it. That only happens for the rare password that is, so the
+   cost is the check: a SHA-1 hash and one Bloom filter lookup.
+
+   If BLOCK_TRIES passwords in a row are all in the blocklist then
+   nearly every password that can be made must be, so rather than
+   loop for ever ctx->failed is set, with a message in ctx->error, and
+   0 is returned (an empty password) - from then on until the settings
+   change. The caller checks ctx->failed.
+
+*/
+
+#define BLOCK_TRIES 100000
+
+size_t generatePassword(sugContext *ctx, char *plain, char *spaced, size_t *spacedLen)
+{
+	if (ctx->failed || (ctx->eng.needSeed && rngSeed(&ctx->eng, ctx->error) != 0))
+	{
+		ctx->failed = 1;
+		*spacedLen = 0;
+		return 0;
+	}
+	rngStartPassword(&ctx->eng);
+	size_t len = makePassword(ctx, plain, spaced, spacedLen);
+	if (ctx->block == NULL) return len;
+	for (int tries = 1; blockListHas(ctx->block, plain, len); tries++)
+	{
+		STAT_ADD(blocked, 1);
+		if (tries == BLOCK_TRIES)
+		{
+			setError(ctx->error, "unable to make a password that is not in the blocklist - use more words with '-w'");
+			ctx->failed = 1;
+			*spacedLen = 0;
+			return 0;
+		}
+		len = makePassword(ctx, plain, spaced, spacedLen);
+	}
+	return len;
+}
+
+/**-------- FUNCTION: arenaInit
+
+   set up the arena 'a' to hand out the caller owned memory 'mem' of
+   'size' bytes. The arena never allocates or frees memory itself -
+   it is emptied for reuse with arenaReset()
+
+*/
+
+void arenaInit(passArena *a, char *mem, size_t size)
+{
+	a->base = mem;
+	a->size = size;
+	a->used = 0;
+}
+
+/**-------- FUNCTION: arenaPassword
+
+   generate a password with the context 'ctx' into the arena 'a',
+   setting '*plain' and (if 'spaced' is not NULL) '*spaced' to NUL
+   terminated strings for the plain form and the form with spaces.
+   Both are made in one pass by generatePassword(). Returns 0 on
+   success, or -1 if the arena did not have room - in which case
+   nothing is taken from it - or if generation failed.
+
+*/
+
+int arenaPassword(passArena *a, sugContext *ctx, char **plain, char **spaced)
+{
+	size_t pmax = policyMaxLength(ctx, ctx->nWords) + 1;
+	size_t smax = spaced ? pmax + policyTokens(&ctx->policy, ctx->nWords) : 0;
+	if (a->size - a->used < pmax + smax) return -1;
+
+	*plain = arenaAlloc(a, pmax);
+	char *s = spaced ? arenaAlloc(a, smax) : NULL;
+	size_t slen = 0;
+	size_t plen = generatePassword(ctx, *plain, s, &slen);
+	(*plain)[plen] = '\0';
+	if (ctx->failed) return -1;
+	if (spaced)
+	{
+		s[slen] = '\0';
+		*spaced = s;
+	}
+	return 0;
+}
+
+
+
+/**-------- FUNCTION: mapFile
+
+   map the whole of the file 'path' into memory read only, and set
+   '*size' to its length. Uses mmap() so no copy is made - except on
+   Windows, where the file is read into an allocated buffer instead.
+   Returns NULL with a message in 'err' if the file cannot be opened
+   or read - or NULL with '*size' of 0 for an empty file. Release the
+   memory with unmapFile().
+
+*/
+
+const char *mapFile(const char *path, size_t *size, char *err)
+{
+	*size = 0;
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		setError(err, "unable to open file '%s': %s", path, strerror(errno));
+		if (fd >= 0) close(fd);
+		return NULL;
+	}
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	*size = (size_t)st.st_size;
+#ifndef _WIN32
+	void *p = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+	{
+		setError(err, "unable to map file '%s': %s", path, strerror(errno));
+		close(fd);
+		*size = 0;
+		return NULL;
+	}
+#else
+	char *p = malloc(*size);
+	if (p == NULL || read(fd, p, *size) != (ssize_t)*size)
+	{
+		setError(err, "unable to read file '%s': %s", path, strerror(errno));
+		free(p);
+		close(fd);
+		*size = 0;
+		return NULL;
+	}
+#endif
+	close(fd);
+	return p;
+}
+
+void unmapFile(const char *p, size_t size)
+{
+	if (p == NULL) return;
+#ifndef _WIN32
+	munmap((void *)p, size);
+#else
+	free((void *)p);
+#endif
+}
+
+/**-------- FUNCTION: dictAlloc
+
+   allocate the packed data and offset index of dictionary 'd' to hold
+   up to 'maxWords' words using up to 'maxChars' characters in total.
+   Just two allocations are made however many words there are.
+   Returns -1 if the memory is not available.
+
+*/
+
+int dictAlloc(wordDict *d, size_t maxWords, size_t maxChars)
+{
+	memset(d, 0, sizeof(*d));
+	d->data = sugMalloc(maxChars);
+	d->offset = sugMalloc(sizeof(uint32_t) * (maxWords + 1));
+	if (d->data == NULL || d->offset == NULL)
+	{
+		free(d->data); d->data = NULL;
+		free(d->offset); d->offset = NULL;
+		return -1;
+	}
+	d->offset[0] = 0;
+	d->owned = 1;
+	return 0;
+}
+
+/**-------- FUNCTION: dictAdd
+
+   append the word 'w' of 'len' characters to the dictionary 'd' -
+   space must already have been allocated by dictAlloc()
+
+*/
+
+void dictAdd(wordDict *d, const char *w, uint32_t len)
+{
+	uint32_t start = d->offset[d->count];
+	memcpy(d->data + start, w, len);
+	if (d->count == 0) d->wordLen = len;
+	else if (d->wordLen != len) d->wordLen = 0;
+	if (len > d->maxLen) d->maxLen = len;
+	d->count++;
+	d->offset[d->count] = start + len;
+}
+
+/**-------- FUNCTION: dictRelease
+
+   free the memory of dictionary 'd' - its file mapping if it was
+   loaded from a binary word list, otherwise its packed data and index,
+   and its wordHash if one was made. Only the hash is freed for
+   dictionaries not 'owned' - the built in one is never released.
+
+*/
+
+void dictRelease(wordDict *d)
+{
+	wordHash *h = atomic_load(&d->hash);
+	if (h != NULL)
+	{
+		free(h->pilot);
+		free(h->slot);
+		free(h);
+		d->hash = NULL;
+	}
+	if (!d->owned) return;
+	if (d->map)
+	{
+		unmapFile(d->map, d->mapSize);
+	}
+	else
+	{
+		free(d->data);
+		free(d->offset);
+	}
+	d->data = NULL; d->offset = NULL; d->map = NULL;
+	d->owned = 0;
+}
+
+/**-------- FUNCTION: dictFixStride
+
+   once all words are loaded into the dictionary 'd', if they are all
+   the same length switch it to a fixed stride and drop the offset
+   index. Three letter words are spread out to WORD_STRIDE bytes each,
+   padded with a NUL, so they can be assembled by assembleStride4().
+   Returns -1 if the memory is not available.
+
+*/
+
+static int dictFixStride(wordDict *d)
+{
+	if (d->wordLen == 0) return 0;
+	d->stride = d->wordLen;
+	free(d->offset); d->offset = NULL;
+	if (d->wordLen != WORD_LEN) return 0;
+
+	char *wide = realloc(d->data, (size_t)d->count * WORD_STRIDE);
+	if (wide == NULL) return -1;
+	// work from the last word backwards so no word is overwritten before it moves
+	for (uint32_t i = d->count; i-- > 0; )
+	{
+		memmove(wide + ((size_t)i * WORD_STRIDE), wide + ((size_t)i * WORD_LEN), WORD_LEN);
+		wide[((size_t)i * WORD_STRIDE) + WORD_LEN] = '\0';
+	}
+	d->data = wide;
+	d->stride = WORD_STRIDE;
+	return 0;
+}
+
+/**-------- FUNCTION: dictDedupe
+
+   remove every repeat of a word from the dictionary 'd' - keeping the
+   first - so each word left adds log2(count) bits of entropy. Words
+   are compared exactly, so 'Cat' and 'cat' are both kept. Repeats are
+   found with a hash table of the word numbers kept, and the words kept
+   are moved up in place. Must be called before dictFinish(). Returns
+   the number removed, or -1 if the memory is not available.
+
+*/
+
+static long dictDedupe(wordDict *d)
+{
+	size_t slots = 16;
+	while (slots < (size_t)d->count * 2) slots *= 2;
+	uint32_t *table = calloc(slots, sizeof(uint32_t));
+	if (table == NULL) return -1;
+	// 'from' is where word i starts, 'to' where the next word kept goes
+	uint32_t kept = 0, from = 0, to = 0;
+	for (uint32_t i = 0; i < d->count; i++)
+	{
+		uint32_t end = d->offset[i+1], len = end - from;
+		const char *w = d->data + from;
+		size_t s = (size_t)wordHashKey(w, len, 0) & (slots - 1);
+		int repeat = 0;
+		for (; table[s] != 0; s = (s + 1) & (slots - 1))
+		{
+			uint32_t k = table[s] - 1;
+			if (d->offset[k+1] - d->offset[k] == len && memcmp(d->data + d->offset[k], w, len) == 0)
+			{
+				repeat = 1;
+				break;
+			}
+		}
+		if (!repeat)
+		{
+			memmove(d->data + to, w, len);
+			table[s] = ++kept;
+			to += len;
+			d->offset[kept] = to;
+		}
+		from = end;
+	}
+	free(table);
+	long removed = (long)(d->count - kept);
+	d->count = kept;
+	return removed;
+}
+
+/**-------- FUNCTION: dictFinish
+
+   once all words are added to the dictionary 'd' by dictAdd(), hand
+   back the unused part of the offset index - or if the words are all
+   the same length, do without it. Also sets the entropy of a word.
+   Returns -1 if the memory is not available.
+
+*/
+
+static int dictFinish(wordDict *d)
+{
+	d->bits = log2(d->count);
+	if (d->wordLen) return dictFixStride(d);
+	uint32_t *shrunk = realloc(d->offset, sizeof(uint32_t) * (d->count + 1));
+	if (shrunk != NULL) d->offset = shrunk;
+	return 0;
+}
+
+/**-------- FUNCTION: dictWord
+
+   the characters of word 'i' of the dictionary 'd' - with its length
+   put in '*len'
+
+*/
+
+static inline const char *dictWord(const wordDict *d, uint32_t i, uint32_t *len)
+{
+	if (d->wordLen)
+	{
+		*len = d->wordLen;
+		return d->data + ((size_t)i * d->stride);
+	}
+	*len = d->offset[i+1] - d->offset[i];
+	return d->data + d->offset[i];
+}
+
+/**-------- FUNCTION: swlChecksum
+
+   checksum of 'len' bytes at 'p' for binary word list files. A 64 bit
+   FNV-1a style hash taken 8 bytes at a time, so checking even a large
+   word list takes very little time.
+
+*/
+
+static uint64_t swlChecksum(const void *p, size_t len)
+{
+	const unsigned char *b = p;
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (; len >= 8; len -= 8, b += 8)
+	{
+		uint64_t v;
+		memcpy(&v, b, 8);
+		h = (h ^ v) * 0x100000001b3ULL;
+	}
+	for (; len > 0; len--, b++) h = (h ^ *b) * 0x100000001b3ULL;
+	return h;
+}
+
+/**-------- FUNCTION: dictFromBinary
+
+   set up the dictionary 'd' to use the binary word list 'map' of
+   'size' bytes (mapped from the file 'path') in place. The header is
+   checked to make sure the index and data lie inside the file and its
+   entropy is that of the word count, and the checksum is verified.
+   Returns -1 with a message in 'err' if the file is not valid. The
+   dictionary owns the mapping from then on.
+
+*/
+
+static int dictFromBinary(wordDict *d, const char *path, const char *map, size_t size, char *err)
+{
+	swlHeader h;
+	if (size < SWL_HEADER_SIZE)
+	{
+		return setError(err, "binary word list '%s' is too short", path);
+	}
+	memcpy(&h, map, sizeof(h));
+	if (h.version != SWL_VERSION || h.byteOrder != SWL_BYTE_ORDER)
+	{
+		return setError(err, "binary word list '%s' is version %u or from a computer with a different byte order"
+			" - recreate it with --compile-wordlist", path, h.version);
+	}
+	uint64_t indexSize = h.wordLen ? 0 : ((uint64_t)h.count + 1) * sizeof(uint32_t);
+	if (h.count == 0 || h.maxLen == 0 || h.maxLen > MAX_WORD_LEN ||
+		(h.wordLen && (h.wordLen != h.maxLen || h.stride < h.wordLen || h.dataSize != (uint64_t)h.count * h.stride)) ||
+		h.dataOffset < SWL_HEADER_SIZE || h.dataOffset > size || h.dataSize > size - h.dataOffset ||
+		(!h.wordLen && (h.indexOffset < SWL_HEADER_SIZE || (h.indexOffset % sizeof(uint32_t)) != 0 ||
+			h.indexOffset > size || indexSize > size - h.indexOffset)))
+	{
+		return setError(err, "binary word list '%s' has an invalid header", path);
+	}
+	// the entropy stored must be that of the word count - so a header
+	// claiming more than the words give is never believed
+	if (!(fabs(h.entropyPerWord - log2(h.count)) < 1e-9))
+	{
+		return setError(err, "binary word list '%s' has an entropy of %.2f bits a word - not %.2f for %u words",
+			path, h.entropyPerWord, log2(h.count), h.count);
+	}
+	if (swlChecksum(map + SWL_HEADER_SIZE, size - SWL_HEADER_SIZE) != h.checksum)
+	{
+		return setError(err, "binary word list '%s' is corrupt - checksum does not match", path);
+	}
+
+	const uint32_t *offset = h.wordLen ? NULL : (const uint32_t *)(map + h.indexOffset);
+	if (offset && (offset[0] != 0 || offset[h.count] != h.dataSize))
+	{
+		return setError(err, "binary word list '%s' has an invalid index", path);
+	}
+	// check offsets only ever go forwards, and words are not too long - so
+	// a bad file can never make buildPassword() read outside the mapping
+	for (uint32_t i = 0; offset && i < h.count; i++)
+	{
+		if (offset[i+1] < offset[i] || offset[i+1] - offset[i] > h.maxLen)
+		{
+			return setError(err, "binary word list '%s' has an invalid index", path);
+		}
+	}
+
+	memset(d, 0, sizeof(*d));
+	// the mapping is read only - the dictionary is never written to once loaded
+	d->data = (char *)(map + h.dataOffset);
+	d->offset = (uint32_t *)offset;
+	d->count = h.count;
+	d->wordLen = h.wordLen;
+	d->stride = h.wordLen ? h.stride : 0;
+	d->maxLen = h.maxLen;
+	d->bits = log2(h.count);
+	d->owned = 1;
+	d->map = map;
+	d->mapSize = size;
+	return 0;
+}
+
+/**-------- FUNCTION: dictFromFile
+
+   build the dictionary 'd' from the word list file 'path', which is
+   memory mapped and tokenised in a single pass straight into the
+   packed word table - there is no allocation per word. Returns -1
+   with a message in 'err' on failure.
+
+   If the file is a binary word list made by '--compile-wordlist' it is
+   used where it is mapped instead - see dictFromBinary().
+
+   Each line provides one word, which is its first field: so plain
+   lists of one word per line, the 'word : definition' format of
+   English-Three-Letter-Word-List.txt, and diceware style lists of
+   'number word' (where the first field is all digits, and so the
+   second field is used) all work. Blank lines and lines starting
+   with '#' are skipped, and so are repeats of a word - see
+   dictDedupe().
+
+*/
+
+int dictFromFile(wordDict *d, const char *path, char *err)
+{
+	size_t size = 0;
+	err[0] = '\0';
+	const char *map = mapFile(path, &size, err);
+	if (map == NULL && err[0]) return -1;
+
+	// a binary word list made by '--compile-wordlist' - use it as mapped
+	if (size >= 4 && memcmp(map, SWL_MAGIC, 4) == 0)
+	{
+		if (dictFromBinary(d, path, map, size, err) == 0) return 0;
+		unmapFile(map, size);
+		return -1;
+	}
+
+	const char *p = map;
+	const char *end = map + size;
+
+	// every word needs at least 2 bytes (a character and a line end)
+	// so this is the most words the file could hold
+	if (dictAlloc(d, (size / 2) + 1, size) != 0)
+	{
+		unmapFile(map, size);
+		return setError(err, "unable to allocate memory for word list '%s'", path);
+	}
+
+	while (p < end)
+	{
+		const char *eol = memchr(p, '\n', end - p);
+		if (eol == NULL) eol = end;
+
+		// skip leading white space
+		while (p < eol && isspace((unsigned char)*p)) p++;
+		if (p < eol && *p != '#')
+		{
+			const char *w = p;
+			while (p < eol && !isspace((unsigned char)*p) && *p != ':') p++;
+			// diceware style 'number word' lines - use the word instead
+			const char *q = w;
+			while (q < p && isdigit((unsigned char)*q)) q++;
+			if (q == p && p < eol && *p != ':')
+			{
+				while (p < eol && isspace((unsigned char)*p)) p++;
+				w = p;
+				while (p < eol && !isspace((unsigned char)*p) && *p != ':') p++;
+			}
+			size_t len = p - w;
+			if (len > MAX_WORD_LEN)
+			{
+				setError(err, "word '%.*s...' in '%s' is longer than %d characters",
+					16, w, path, MAX_WORD_LEN);
+				unmapFile(map, size);
+				dictRelease(d);
+				return -1;
+			}
+			if (len > 0) dictAdd(d, w, (uint32_t)len);
+		}
+		p = eol + 1;
+	}
+	unmapFile(map, size);
+
+	if (d->count == 0)
+	{
+		dictRelease(d);
+		return setError(err, "no words found in word list file '%s'", path);
+	}
+	if (dictDedupe(d) < 0 || dictFinish(d) != 0)
+	{
+		dictRelease(d);
+		return setError(err, "unable to allocate memory for word list '%s'", path);
+	}
+	return 0;
+}
+
+
+/**-------- FUNCTION: sugCompileWordList
+
+   convert the word list file 'in' to the binary word list 'out' - see
+   swlHeader for the layout. The index is left out when all words are
+   the same length, as each word can then be found from its position -
+   and three letter words are kept in four byte entries, just as when
+   the word list is loaded as text.
+
+*/
+
+int sugCompileWordList(sugContext *ctx, const char *in, const char *out)
+{
+	wordDict d;
+	if (dictFromFile(&d, in, ctx->error) != 0) return -1;
+
+	swlHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SWL_MAGIC, 4);
+	h.version = SWL_VERSION;
+	h.byteOrder = SWL_BYTE_ORDER;
+	h.count = d.count;
+	h.wordLen = d.wordLen;
+	h.maxLen = d.maxLen;
+	h.stride = d.stride;
+	size_t indexSize = d.wordLen ? 0 : sizeof(uint32_t) * (d.count + 1);
+	h.indexOffset = d.wordLen ? 0 : SWL_HEADER_SIZE;
+	h.dataOffset = SWL_HEADER_SIZE + indexSize;
+	h.dataSize = d.wordLen ? (uint64_t)d.count * d.stride : d.offset[d.count];
+	h.entropyPerWord = d.bits;
+
+	// build the file in memory so the checksum can be made over it
+	size_t size = h.dataOffset + h.dataSize;
+	char *file = calloc(1, size);
+	if (file == NULL)
+	{
+		dictRelease(&d);
+		return setError(ctx->error, "unable to allocate memory for binary word list '%s'", out);
+	}
+	if (indexSize) memcpy(file + h.indexOffset, d.offset, indexSize);
+	memcpy(file + h.dataOffset, d.data, h.dataSize);
+	h.checksum = swlChecksum(file + SWL_HEADER_SIZE, size - SWL_HEADER_SIZE);
+	memcpy(file, &h, sizeof(h));
+	dictRelease(&d);
+
+	FILE *fp = fopen(out, "wb");
+	int ok = fp != NULL && fwrite(file, 1, size, fp) == size;
+	if (fp != NULL && fclose(fp) != 0) ok = 0;
+	free(file); file = NULL;
+	if (!ok)
+	{
+		return setError(ctx->error, "unable to write binary word list '%s': %s", out, strerror(errno));
+	}
+	return 0;
+}
+
+
+/*-----------------------*/
+/* MARKOV CHAINS         */
+/*-----------------------*/
+
+/**-------- FUNCTION: aliasBuild
+
+   fill in the alias table entries 'cut' and 'alias' for a row of 'n'
+   choices with the integer weights 'w', which add up to 'total'. This
+   is Vose's way of building Walker's alias table, done in integers so
+   choice i is picked with a chance of exactly w[i] / total. Each of the
+   'n' entries holds 'total' units and choice i needs n * w[i] of them:
+   a choice needing less than a whole entry keeps what it needs of its
+   own, and the rest of that entry goes to one needing more - its alias.
+
+*/
+
+static void aliasBuild(const uint32_t *w, uint32_t n, uint32_t total, uint32_t *cut, uint16_t *alias)
+{
+	uint64_t need[MARKOV_STATES];
+	uint16_t small[MARKOV_STATES], large[MARKOV_STATES];
+	uint32_t ns = 0, nl = 0;
+	for (uint32_t i = 0; i < n; i++)
+	{
+		need[i] = (uint64_t)n * w[i];
+		if (need[i] < total) small[ns++] = (uint16_t)i;
+		else large[nl++] = (uint16_t)i;
+	}
+	while (ns > 0 && nl > 0)
+	{
+		uint16_t s = small[--ns], l = large[nl - 1];
+		cut[s] = (uint32_t)need[s];
+		alias[s] = l;
+		need[l] -= total - need[s];
+		if (need[l] < total)
+		{
+			nl--;
+			small[ns++] = l;
+		}
+	}
+	// what is left needs exactly a whole entry of its own
+	while (nl > 0) { uint16_t l = large[--nl]; cut[l] = total; alias[l] = l; }
+	while (ns > 0) { uint16_t s = small[--ns]; cut[s] = total; alias[s] = s; }
+}
+
+/**-------- FUNCTION: markovChoices / markovCounts
+
+   markovChoices() is the number of letters with a count in 'count'
+   that lead on from the pair 's' to a pair still 'live'.
+
+   markovCounts() picks the counts the letter after the pair 's' is
+   chosen with: the letters that follow the pair in the words ('count')
+   if there are MARKOV_MIN_CHOICES of them - otherwise the letters that
+   follow its second letter ('follow').
+
+*/
+
+static uint32_t markovChoices(const uint32_t *count, uint32_t s, const unsigned char *live)
+{
+	uint32_t n = 0;
+	for (uint32_t l = 0; l < MARKOV_LETTERS; l++)
+	{
+		if (count[l] && live[((s % MARKOV_LETTERS) * MARKOV_LETTERS) + l]) n++;
+	}
+	return n;
+}
+
+static const uint32_t *markovCounts(const uint32_t (*count)[MARKOV_LETTERS + 1], const uint32_t (*follow)[MARKOV_LETTERS],
+	uint32_t s, const unsigned char *live)
+{
+	if (markovChoices(count[s], s, live) >= MARKOV_MIN_CHOICES) return count[s];
+	return follow[s % MARKOV_LETTERS];
+}
+
+/**-------- FUNCTION: markovBuild
+
+   train the markov model 'm' from the words of the dictionary 'd' -
+   see markovModel. The pairs and letters each letter follows, and the
+   pairs words start with, are counted in one pass over the words. Then
+   pairs are left out until every pair kept has at least
+   MARKOV_MIN_CHOICES letters to go on to (see markovCounts()), and the
+   rows of the alias table made from the counts. Weights are halved
+   (never to 0) if a row's add up to more than 32 bits. Last the
+   min-entropy of each number of syllables is
+   found, by following the most likely way to reach each pair one
+   letter at a time. Returns -1 with a message in 'err' if the words
+   do not have enough letters in common to make passwords from.
+
+*/
+
+static inline void markovCount(uint32_t *c) { if (*c < UINT32_MAX) (*c)++; }
+
+int markovBuild(const wordDict *d, markovModel *m, char *err)
+{
+	// count[pair][letter] - times 'letter' follows each pair - and
+	// count[pair][MARKOV_LETTERS] - times a word starts with the pair
+	uint32_t (*count)[MARKOV_LETTERS + 1] = calloc(MARKOV_STATES, sizeof(*count));
+	// follow[letter][next] - times 'next' follows each letter
+	uint32_t follow[MARKOV_LETTERS][MARKOV_LETTERS];
+	memset(follow, 0, sizeof(follow));
+	double *bits = malloc(sizeof(double) * MARKOV_ENTRIES);
+	if (count == NULL || bits == NULL)
+	{
+		free(count); free(bits);
+		return setError(err, "unable to allocate memory for the markov model");
+	}
+	for (uint32_t i = 0; i < d->count; i++)
+	{
+		uint32_t len, run = 0, pair = 0;
+		const char *w = dictWord(d, i, &len);
+		for (uint32_t c = 0; c < len; c++)
+		{
+			// 'run' letters in a row so far - the last two are 'pair'
+			int l = tolower((unsigned char)w[c]) - 'a';
+			if (l < 0 || l >= MARKOV_LETTERS)
+			{
+				run = 0;
+				continue;
+			}
+			if (run >= 1) markovCount(&follow[pair % MARKOV_LETTERS][l]);
+			if (run >= 2)
+			{
+				if (run == 2) markovCount(&count[pair][MARKOV_LETTERS]);
+				markovCount(&count[pair][l]);
+			}
+			pair = ((pair % MARKOV_LETTERS) * MARKOV_LETTERS) + (uint32_t)l;
+			run++;
+		}
+	}
+
+	// leave out pairs with too few letters to go on to - until none change
+	unsigned char live[MARKOV_STATES];
+	memset(live, 1, sizeof(live));
+	for (int changed = 1; changed; )
+	{
+		changed = 0;
+		for (uint32_t s = 0; s < MARKOV_STATES; s++)
+		{
+			if (live[s] && markovChoices(markovCounts(count, follow, s, live), s, live) < MARKOV_MIN_CHOICES)
+			{
+				live[s] = 0;
+				changed = 1;
+			}
+		}
+	}
+
+	// a row for each pair kept - then the start row of all pairs kept that
+	// start a word
+	memset(m, 0, sizeof(*m));
+	uint32_t e = 0, w[MARKOV_STATES];
+	for (uint32_t s = 0; s <= MARKOV_STATES; s++)
+	{
+		markovRow *row = &m->row[s];
+		row->first = e;
+		if (s != MARKOV_START && !live[s]) continue;
+		uint32_t choices = s == MARKOV_START ? MARKOV_STATES : MARKOV_LETTERS;
+		const uint32_t *use = s == MARKOV_START ? NULL : markovCounts(count, follow, s, live);
+		uint64_t total = 0;
+		for (uint32_t l = 0; l < choices; l++)
+		{
+			uint32_t to = s == MARKOV_START ? l : ((s % MARKOV_LETTERS) * MARKOV_LETTERS) + l;
+			uint32_t c = s == MARKOV_START ? count[l][MARKOV_LETTERS] : use[l];
+			if (c == 0 || !live[to]) continue;
+			m->next[e++] = (uint16_t)to;
+			w[row->count++] = c;
+			total += c;
+		}
+		while (total > UINT32_MAX)
+		{
+			total = 0;
+			for (uint32_t i = 0; i < row->count; i++) total += w[i] = (w[i] + 1) / 2;
+		}
+		int same = 1;
+		for (uint32_t i = 0; i < row->count; i++)
+		{
+			if (w[i] != w[0]) same = 0;
+			bits[row->first + i] = log2((double)w[i] / (double)total);
+		}
+		row->total = same ? 0 : (uint32_t)total;
+		if (!same) aliasBuild(w, row->count, row->total, m->cut + row->first, m->alias + row->first);
+		if (s != MARKOV_START && row->count) m->pairs++;
+	}
+	free(count); count = NULL;
+	if (m->row[MARKOV_START].count == 0)
+	{
+		free(bits);
+		return setError(err, "the words do not have enough letters in common to make markov passwords");
+	}
+
+	// the most likely way to reach each pair - as log2() of its chance
+	double best[MARKOV_STATES], next[MARKOV_STATES];
+	for (uint32_t s = 0; s < MARKOV_STATES; s++) best[s] = -INFINITY;
+	const markovRow *start = &m->row[MARKOV_START];
+	for (uint32_t i = start->first; i < start->first + start->count; i++) best[m->next[i]] = bits[i];
+	int letters = 2;
+	for (int k = 1; k <= MARKOV_MAX_SYLLABLES; k++)
+	{
+		for (; letters < k * MARKOV_SYLLABLE; letters++)
+		{
+			for (uint32_t s = 0; s < MARKOV_STATES; s++) next[s] = -INFINITY;
+			for (uint32_t s = 0; s < MARKOV_STATES; s++)
+			{
+				const markovRow *row = &m->row[s];
+				if (best[s] == -INFINITY) continue;
+				for (uint32_t i = row->first; i < row->first + row->count; i++)
+				{
+					if (best[s] + bits[i] > next[m->next[i]]) next[m->next[i]] = best[s] + bits[i];
+				}
+			}
+			memcpy(best, next, sizeof(best));
+		}
+		double most = -INFINITY;
+		for (uint32_t s = 0; s < MARKOV_STATES; s++) if (best[s] > most) most = best[s];
+		m->minBits[k] = -most;
+	}
+	free(bits);
+	return 0;
+}
+
+
+/*-----------------------*/
+/* BLOCKLISTS            */
+/*-----------------------*/
+
+/**-------- FUNCTION: sha1Block / sha1
+
+   sha1() puts the 20 byte SHA-1 hash (FIPS 180-4) of the 'len' bytes
+   at 'msg' in 'out' - sha1Block() adds one 64 byte block to the hash
+   state 'h'. SHA-1 is only used to match passwords against breached
+   password lists, which are published as SHA-1 hashes - it is not
+   used to protect anything.
+
+*/
+
+static void sha1Block(uint32_t h[5], const unsigned char *blk)
+{
+	// the message schedule is kept as the last 16 words only
+	uint32_t w[16];
+	for (int i = 0; i < 16; i++)
+	{
+		w[i] = ((uint32_t)blk[4*i] << 24) | ((uint32_t)blk[4*i+1] << 16) |
+		       ((uint32_t)blk[4*i+2] << 8) | blk[4*i+3];
+	}
+
+	// the four sets of 20 rounds each have their own loop - so there is
+	// no choosing of the round function inside them
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], t;
+#define SHA1_W(i) (i < 16 ? w[i] : (w[i & 15] = ROTL32(w[(i-3) & 15] ^ w[(i-8) & 15] ^ w[(i-14) & 15] ^ w[i & 15], 1)))
+#define SHA1_ROUND(f, k) t = ROTL32(a, 5) + (f) + e + (k) + SHA1_W(i); \
+	e = d; d = c; c = ROTL32(b, 30); b = a; a = t;
+	int i = 0;
+	for (; i < 20; i++) { SHA1_ROUND(d ^ (b & (c ^ d)), 0x5a827999); }
+	for (; i < 40; i++) { SHA1_ROUND(b ^ c ^ d, 0x6ed9eba1); }
+	for (; i < 60; i++) { SHA1_ROUND((b & c) | (d & (b | c)), 0x8f1bbcdc); }
+	for (; i < 80; i++) { SHA1_ROUND(b ^ c ^ d, 0xca62c1d6); }
+#undef SHA1_ROUND
+#undef SHA1_W
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+void sha1(const void *msg, size_t len, unsigned char out[SBL_HASH_LEN])
+{
+	uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+	const unsigned char *p = msg;
+	size_t full = len & ~(size_t)63;
+	for (size_t b = 0; b < full; b += 64) sha1Block(h, p + b);
+
+	// the last part block, a 1 bit, zeros, and the length in bits - which
+	// takes one block or two
+	unsigned char tail[128];
+	size_t rest = len - full;
+	size_t tailLen = rest < 56 ? 64 : 128;
+	memcpy(tail, p + full, rest);
+	tail[rest] = 0x80;
+	memset(tail + rest + 1, 0, tailLen - rest - 1);
+	uint64_t bits = (uint64_t)len * 8;
+	for (int i = 0; i < 8; i++) tail[tailLen - 1 - i] = (unsigned char)(bits >> (8 * i));
+	for (size_t b = 0; b < tailLen; b += 64) sha1Block(h, tail + b);
+
+	for (int i = 0; i < 5; i++)
+	{
+		out[4*i]   = (unsigned char)(h[i] >> 24);
+		out[4*i+1] = (unsigned char)(h[i] >> 16);
+		out[4*i+2] = (unsigned char)(h[i] >> 8);
+		out[4*i+3] = (unsigned char)h[i];
+	}
+}
+
+/**-------- FUNCTION: hashPrefix
+
+   the first 8 bytes of the hash 'h' as a number - big endian, so
+   hashes sort in the same order as their prefixes
+
+*/
+
+static inline uint64_t hashPrefix(const unsigned char *h)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++) v = (v << 8) | h[i];
+	return v;
+}
+
+/**-------- FUNCTION: bloomAdd / bloomHas
+
+   set - or test - the BLOOM_PROBES bits for the hash 'h' in the Bloom
+   filter 'bloom' of 'mask' + 1 blocks. The block is picked by the
+   hash prefix and the bits in it by 9 bit slices of the next 8 bytes
+   - a SHA-1 hash is already evenly spread, so no more hashing is
+   needed.
+
+*/
+
+static inline uint64_t bloomBits(const unsigned char *h)
+{
+	uint64_t v;
+	memcpy(&v, h + 8, sizeof(v));
+	return v;
+}
+
+static void bloomAdd(uint64_t *bloom, uint64_t mask, const unsigned char *h)
+{
+	uint64_t *blk = bloom + ((hashPrefix(h) & mask) * 8);
+	uint64_t v = bloomBits(h);
+	for (int i = 0; i < BLOOM_PROBES; i++, v >>= 9) blk[(v & 511) >> 6] |= 1ULL << (v & 63);
+}
+
+static inline int bloomHas(const uint64_t *bloom, uint64_t mask, const unsigned char *h)
+{
+	const uint64_t *blk = bloom + ((hashPrefix(h) & mask) * 8);
+	uint64_t v = bloomBits(h);
+	for (int i = 0; i < BLOOM_PROBES; i++, v >>= 9)
+	{
+		if (!(blk[(v & 511) >> 6] & (1ULL << (v & 63)))) return 0;
+	}
+	return 1;
+}
+
+/**-------- FUNCTION: hashFind
+
+   search the 'count' sorted hashes at 'hash' for 'h' - returns 1 if it
+   is there. An interpolation search: as SHA-1 hashes are evenly spread
+   the place to look is worked out from where the prefix of 'h' falls
+   between those at each end of the range, which finds it in a few
+   steps even among hundreds of millions. After 16 steps it switches
+   to halving the range, so even a file that is not evenly spread
+   can never make it slow.
+
+*/
+
+static int hashFind(const unsigned char *hash, uint64_t count, const unsigned char *h)
+{
+	uint64_t key = hashPrefix(h);
+	uint64_t lo = 0, hi = count;    // the range left is lo to hi - 1
+	for (int step = 0; lo < hi; step++)
+	{
+		uint64_t klo = hashPrefix(hash + (lo * SBL_HASH_LEN));
+		uint64_t khi = hashPrefix(hash + ((hi - 1) * SBL_HASH_LEN));
+		if (key < klo || key > khi) return 0;
+		uint64_t mid = lo + ((hi - lo) / 2);
+		if (step < 16 && khi > klo)
+		{
+			mid = lo + (uint64_t)((double)(key - klo) / (double)(khi - klo) * (double)(hi - 1 - lo));
+			if (mid >= hi) mid = hi - 1;
+		}
+		int c = memcmp(h, hash + (mid * SBL_HASH_LEN), SBL_HASH_LEN);
+		if (c == 0) return 1;
+		if (c < 0) hi = mid;
+		else lo = mid + 1;
+	}
+	return 0;
+}
+
+/**-------- FUNCTION: blockListHas
+
+   returns 1 if the password 'pw' of 'len' characters is in the
+   blocklist 'b' - see blockList for how
+
+*/
+
+int blockListHas(const blockList *b, const char *pw, size_t len)
+{
+	unsigned char h[SBL_HASH_LEN];
+	sha1(pw, len, h);
+	if (!bloomHas(b->bloom, b->bloomMask, h)) return 0;
+	return hashFind(b->hash, b->count, h);
+}
+
+/**-------- FUNCTION: hexHash
+
+   read the SHA-1 hash in hex at the start of the 'len' character line
+   'p' into 'out'. The line must be the 40 hex digits alone, or
+   followed by ':' (as 'HASH:COUNT' lines of breached password lists
+   are). Returns -1 if the line is not a hash.
+
+*/
+
+static int hexHash(const char *p, size_t len, unsigned char *out)
+{
+	if (len < 2 * SBL_HASH_LEN || (len > 2 * SBL_HASH_LEN && p[2 * SBL_HASH_LEN] != ':')) return -1;
+	for (int i = 0; i < 2 * SBL_HASH_LEN; i++)
+	{
+		int c = (unsigned char)p[i], v;
+		if (c >= '0' && c <= '9') v = c - '0';
+		else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+		else return -1;
+		if (i % 2 == 0) out[i/2] = (unsigned char)(v << 4);
+		else out[i/2] |= (unsigned char)v;
+	}
+	return 0;
+}
+
+static int hashCmp(const void *a, const void *b)
+{
+	return memcmp(a, b, SBL_HASH_LEN);
+}
+
+/**-------- FUNCTION: sugCompileBlocklist
+
+   convert 'in' to the blocklist file 'out' - see blockList for the
+   layout. Each line of 'in' is a SHA-1 hash in hex (see hexHash()) or
+   else a password, which is hashed. Hashes are sorted - unless they
+   already are, as breached password lists ordered by hash are - and
+   repeats dropped, then the Bloom filter is built over them. All the
+   hashes are held in memory while this is done: 20 bytes each.
+
+*/
+
+long long sugCompileBlocklist(sugContext *ctx, const char *in, const char *out)
+{
+	size_t size = 0;
+	ctx->error[0] = '\0';
+	const char *map = mapFile(in, &size, ctx->error);
+	if (map == NULL)
+	{
+		return ctx->error[0] ? -1 : setError(ctx->error, "no passwords or hashes found in '%s'", in);
+	}
+
+	// one hash per line at most
+	uint64_t lines = 1;
+	const char *end = map + size;
+	for (const char *p = map; (p = memchr(p, '\n', end - p)) != NULL; p++) lines++;
+	unsigned char *hash = sugMalloc(lines * SBL_HASH_LEN);
+	if (hash == NULL)
+	{
+		unmapFile(map, size);
+		return setError(ctx->error, "unable to allocate memory for %llu hashes", (unsigned long long)lines);
+	}
+
+	uint64_t n = 0;
+	int sorted = 1;
+	for (const char *p = map; p < end; )
+	{
+		const char *eol = memchr(p, '\n', end - p);
+		if (eol == NULL) eol = end;
+		size_t len = (size_t)(eol - p);
+		if (len > 0 && p[len-1] == '\r') len--;
+		if (len > 0)
+		{
+			unsigned char *h = hash + (n * SBL_HASH_LEN);
+			if (hexHash(p, len, h) != 0) sha1(p, len, h);
+			if (n > 0 && memcmp(h - SBL_HASH_LEN, h, SBL_HASH_LEN) > 0) sorted = 0;
+			n++;
+		}
+		p = eol + 1;
+	}
+	unmapFile(map, size);
+	if (n == 0)
+	{
+		free(hash);
+		return setError(ctx->error, "no passwords or hashes found in '%s'", in);
+	}
+	if (!sorted) qsort(hash, n, SBL_HASH_LEN, hashCmp);
+	uint64_t count = 1;
+	for (uint64_t i = 1; i < n; i++)
+	{
+		if (memcmp(hash + (i * SBL_HASH_LEN), hash + ((count - 1) * SBL_HASH_LEN), SBL_HASH_LEN) != 0)
+		{
+			memmove(hash + (count * SBL_HASH_LEN), hash + (i * SBL_HASH_LEN), SBL_HASH_LEN);
+			count++;
+		}
+	}
+
+	uint64_t blocks = 1;
+	while (blocks * 512 < count * BLOOM_BITS_PER_HASH) blocks *= 2;
+	uint64_t *bloom = calloc(blocks, 64);
+	if (bloom == NULL)
+	{
+		free(hash);
+		return setError(ctx->error, "unable to allocate memory for the Bloom filter of '%s'", out);
+	}
+	for (uint64_t i = 0; i < count; i++) bloomAdd(bloom, blocks - 1, hash + (i * SBL_HASH_LEN));
+
+	sblHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SBL_MAGIC, 4);
+	h.version = SBL_VERSION;
+	h.byteOrder = SWL_BYTE_ORDER;
+	h.count = count;
+	h.bloomBlocks = blocks;
+	h.bloomOffset = SBL_HEADER_SIZE;
+	h.hashOffset = SBL_HEADER_SIZE + (blocks * 64);
+
+	FILE *fp = fopen(out, "wb");
+	int ok = fp != NULL && fwrite(&h, sizeof(h), 1, fp) == 1 &&
+		fwrite(bloom, 64, blocks, fp) == blocks &&
+		fwrite(hash, SBL_HASH_LEN, count, fp) == count;
+	if (fp != NULL && fclose(fp) != 0) ok = 0;
+	free(bloom); bloom = NULL;
+	free(hash); hash = NULL;
+	if (!ok)
+	{
+		return setError(ctx->error, "unable to write blocklist '%s': %s", out, strerror(errno));
+	}
+	return (long long)count;
+}
+
+
+/*-----------------------*/
+/* ENCODING              */
+/*-----------------------*/
+
+/* seeds tried before giving up on making a wordHash */
+#define WHASH_SEEDS 64
+
+static inline unsigned char lowerAscii(unsigned char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/* 1 if the 'len' characters at 'a' and 'b' are the same ignoring case */
+static int sameWord(const char *a, const char *b, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		if (lowerAscii((unsigned char)a[i]) != lowerAscii((unsigned char)b[i])) return 0;
+	}
+	return 1;
+}
+
+/**-------- FUNCTION: wordHashBuild
+
+   make the minimal perfect hash 'h' of the words of dictionary 'd' -
+   see wordHash. The words are put in their buckets, then the buckets
+   are placed biggest first (while most slots are free) by trying
+   pilot values until one moves all of a bucket's words to free slots.
+   If a bucket cannot be placed, or two words share a hash, it starts
+   again with the next seed. Returns -1 with a message in 'err' if the
+   dictionary has the same word twice, or no seed works.
+
+*/
+
+int wordHashBuild(const wordDict *d, wordHash *h, char *err)
+{
+	uint32_t n = d->count;
+	uint32_t buckets = (n / WHASH_BUCKET_SIZE) + 1;
+	uint64_t *key = sugMalloc(sizeof(uint64_t) * n);
+	uint32_t *order = sugMalloc(sizeof(uint32_t) * n);            // words in bucket order
+	uint32_t *start = sugMalloc(sizeof(uint32_t) * (buckets + 1)); // each bucket's first in 'order'
+	uint32_t *byFill = sugMalloc(sizeof(uint32_t) * buckets);      // buckets biggest first
+	unsigned char *taken = sugMalloc(n);
+	h->pilot = sugMalloc(sizeof(uint32_t) * buckets);
+	h->slot = sugMalloc(sizeof(uint32_t) * n);
+	int result = -1;
+	if (!key || !order || !start || !byFill || !taken || !h->pilot || !h->slot)
+	{
+		setError(err, "unable to allocate memory for the dictionary hash");
+		goto done;
+	}
+
+	for (uint64_t seed = 0; seed < WHASH_SEEDS; seed++)
+	{
+		// put the words in their buckets with a counting sort
+		memset(start, 0, sizeof(uint32_t) * (buckets + 1));
+		uint32_t most = 0;
+		for (uint32_t i = 0; i < n; i++)
+		{
+			uint32_t len;
+			const char *w = dictWord(d, i, &len);
+			key[i] = wordHashKey(w, len, seed);
+			start[wordHashBucket(key[i], buckets) + 1]++;
+		}
+		for (uint32_t b = 0; b < buckets; b++)
+		{
+			if (start[b+1] > most) most = start[b+1];
+			start[b+1] += start[b];
+		}
+		for (uint32_t i = 0; i < n; i++)
+		{
+			uint32_t b = wordHashBucket(key[i], buckets);
+			order[start[b]++] = i;
+		}
+		for (uint32_t b = buckets; b > 0; b--) start[b] = start[b-1];
+		start[0] = 0;
+
+		// the buckets by size - biggest first
+		uint32_t k = 0;
+		for (uint32_t size = most; size > 0; size--)
+		{
+			for (uint32_t b = 0; b < buckets; b++)
+			{
+				if (start[b+1] - start[b] == size) byFill[k++] = b;
+			}
+		}
+
+		// two words with the same hash can never be placed apart - which
+		// is either the same word twice, or needs another seed
+		int clash = 0;
+		for (uint32_t b = 0; b < buckets && !clash; b++)
+		{
+			for (uint32_t x = start[b]; x < start[b+1] && !clash; x++)
+			{
+				for (uint32_t y = x + 1; y < start[b+1]; y++)
+				{
+					if (key[order[x]] != key[order[y]]) continue;
+					uint32_t lx, ly;
+					const char *wx = dictWord(d, order[x], &lx);
+					const char *wy = dictWord(d, order[y], &ly);
+					if (lx == ly && sameWord(wx, wy, lx))
+					{
+						setError(err, "the word '%.*s' is in the dictionary more than once", (int)lx, wx);
+						goto done;
+					}
+					clash = 1;
+					break;
+				}
+			}
+		}
+		if (clash) continue;
+
+		memset(taken, 0, n);
+		int placed = 1;
+		for (uint32_t f = 0; f < k && placed; f++)
+		{
+			uint32_t b = byFill[f];
+			placed = 0;
+			for (uint32_t p = 0; p < UINT32_MAX && !placed; p++)
+			{
+				uint32_t x = start[b];
+				for (; x < start[b+1]; x++)
+				{
+					uint32_t s = wordHashSlot(key[order[x]], p, n);
+					if (taken[s]) break;
+					taken[s] = 1;
+					h->slot[s] = order[x];
+				}
+				if (x == start[b+1])
+				{
+					h->pilot[b] = p;
+					placed = 1;
+				}
+				else
+				{
+					// free the slots this pilot took before it failed
+					while (x-- > start[b]) taken[wordHashSlot(key[order[x]], p, n)] = 0;
+				}
+			}
+		}
+		if (!placed) continue;
+		// empty buckets are never looked in - but keep them defined
+		for (uint32_t b = 0; b < buckets; b++)
+		{
+			if (start[b+1] == start[b]) h->pilot[b] = 0;
+		}
+		h->seed = seed;
+		h->buckets = buckets;
+		result = 0;
+		goto done;
+	}
+	setError(err, "unable to make a hash of the dictionary words");
+
+done:
+	free(key); free(order); free(start); free(byFill); free(taken);
+	if (result != 0)
+	{
+		free(h->pilot); h->pilot = NULL;
+		free(h->slot); h->slot = NULL;
+	}
+	return result;
+}
+
+/**-------- FUNCTION: dictHash
+
+   the wordHash of dictionary 'd' - made the first time it is wanted,
+   by whichever thread gets there first. Returns NULL with a message in
+   'err' if it cannot be made.
+
+*/
+
+static pthread_mutex_t hashLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const wordHash *dictHash(wordDict *d, char *err)
+{
+	wordHash *h = atomic_load_explicit(&d->hash, memory_order_acquire);
+	if (h != NULL) return h;
+	pthread_mutex_lock(&hashLock);
+	h = atomic_load_explicit(&d->hash, memory_order_relaxed);
+	if (h == NULL)
+	{
+		h = sugMalloc(sizeof(wordHash));
+		if (h == NULL)
+		{
+			setError(err, "unable to allocate memory for the dictionary hash");
+		}
+		else if (wordHashBuild(d, h, err) != 0)
+		{
+			free(h);
+			h = NULL;
+		}
+		else
+		{
+			atomic_store_explicit(&d->hash, h, memory_order_release);
+		}
+	}
+	pthread_mutex_unlock(&hashLock);
+	return h;
+}
+
+/**-------- FUNCTION: sugWordIndex
+
+   number of the dictionary word 'w' - see libsugpass.h
+
+*/
+
+long sugWordIndex(sugContext *ctx, const char *w, size_t len)
+{
+	const wordDict *d = ctx->dict;
+	const wordHash *h = dictHash(ctx->dict, ctx->error);
+	if (h == NULL) return -1;
+	uint64_t key = wordHashKey(w, len, h->seed);
+	uint32_t i = h->slot[wordHashSlot(key, h->pilot[wordHashBucket(key, h->buckets)], d->count)];
+	uint32_t dlen;
+	const char *dw = dictWord(d, i, &dlen);
+	if (dlen != len || !sameWord(dw, w, len))
+	{
+		return setError(ctx->error, "'%.*s' is not a word in the dictionary", (int)len, w);
+	}
+	return (long)i;
+}
+
+/**-------- FUNCTION: sugEncode
+
+   the password for a number - see libsugpass.h. The number is divided
+   by the dictionary size once per word, the remainders being the word
+   numbers, least significant first.
+
+*/
+
+long sugEncode(sugContext *ctx, const unsigned char *num, size_t len, int nWords, char *out, size_t outLen)
+{
+	const wordDict *d = ctx->dict;
+	uint32_t radix = d->count;
+	if (radix < 2) return setError(ctx->error, "the dictionary needs at least 2 words to encode numbers");
+	if (len > SUG_CODE_MAX) return setError(ctx->error, "numbers to encode can be at most %d bytes", SUG_CODE_MAX);
+	// the fewest words for any number of 'len' bytes - allowing for log2()
+	// being a tiny amount out when the dictionary size is a power of 2
+	if (nWords == 0) nWords = (int)ceil(((8.0 * len) / d->bits) - 1e-9);
+	if (nWords < 1) nWords = 1;
+	if (nWords > 8 * SUG_CODE_MAX) return setError(ctx->error, "at most %d words can be used to encode a number", 8 * SUG_CODE_MAX);
+	// words that vary in length need something between them to be decoded
+	char sep = ctx->policy.separator ? ctx->policy.separator : (d->wordLen ? '\0' : ' ');
+	if (outLen < ((size_t)nWords * (d->maxLen + 1)) + 1)
+	{
+		return setError(ctx->error, "not enough room for a password of %d words", nWords);
+	}
+
+	unsigned char v[SUG_CODE_MAX];
+	uint32_t digit[8 * SUG_CODE_MAX];
+	memcpy(v, num, len);
+	for (int i = 0; i < nWords; i++)
+	{
+		uint64_t rem = 0;
+		for (size_t b = 0; b < len; b++)
+		{
+			uint64_t cur = (rem << 8) | v[b];
+			v[b] = (unsigned char)(cur / radix);
+			rem = cur % radix;
+		}
+		digit[i] = (uint32_t)rem;
+	}
+	for (size_t b = 0; b < len; b++)
+	{
+		if (v[b]) return setError(ctx->error, "the number is too large for %d words - use more with '-w'", nWords);
+	}
+
+	size_t pos = 0;
+	for (int i = nWords - 1; i >= 0; i--)
+	{
+		uint32_t wlen;
+		const char *w = dictWord(d, digit[i], &wlen);
+		memcpy(out + pos, w, wlen);
+		pos += wlen;
+		if (sep && i > 0) out[pos++] = sep;
+	}
+	out[pos] = '\0';
+	return (long)pos;
+}
+
+/**-------- FUNCTION: sugDecode
+
+   the number a password encodes - see libsugpass.h. Each word's number
+   is added in as the next digit: the number so far is multiplied by
+   the dictionary size, one byte at a time from the least significant.
+
+*/
+
+int sugDecode(sugContext *ctx, const char *pw, unsigned char *num, size_t numLen)
+{
+	const wordDict *d = ctx->dict;
+	char sep = ctx->policy.separator;
+	size_t len = strlen(pw);
+	int split = d->wordLen == 0 || strchr(pw, ' ') != NULL || (sep && strchr(pw, sep) != NULL);
+	if (!split && len % d->wordLen != 0)
+	{
+		return setError(ctx->error, "'%s' is not made of %u letter words", pw, d->wordLen);
+	}
+
+	memset(num, 0, numLen);
+	int nWords = 0;
+	for (const char *p = pw, *end = pw + len; p < end; )
+	{
+		const char *w = p;
+		if (split)
+		{
+			while (p < end && *p != ' ' && *p != sep) p++;
+		}
+		else
+		{
+			p += d->wordLen;
+		}
+		size_t wlen = (size_t)(p - w);
+		if (split) while (p < end && (*p == ' ' || *p == sep)) p++;
+		if (wlen == 0) continue;
+
+		long idx = sugWordIndex(ctx, w, wlen);
+		if (idx < 0) return -1;
+		uint64_t carry = (uint64_t)idx;
+		for (size_t b = numLen; b-- > 0; )
+		{
+			uint64_t cur = ((uint64_t)num[b] * d->count) + carry;
+			num[b] = (unsigned char)cur;
+			carry = cur >> 8;
+		}
+		if (carry) return setError(ctx->error, "'%s' is too large a number for %zu bytes", pw, numLen);
+		nWords++;
+	}
+	if (nWords == 0) return setError(ctx->error, "no words found in '%s'", pw);
+	return nWords;
+}
+
+
+/*-----------------------*/
+/* HASHING               */
+/*-----------------------*/
+
+/*
+	Salted password hashes for '--hash': SHA-512-crypt (the '$6$' hash
+	of glibc crypt(3), as used in /etc/shadow) and PBKDF2-HMAC-SHA256
+	(in the '$pbkdf2-sha256$' form used by Python's passlib). Both are
+	thousands of rounds of one hash function, so almost all the time is
+	spent in the SHA-256 or SHA-512 block function.
+
+	So several passwords are hashed at once ("multi buffer"): lane 'l'
+	of every vector holds the state of password 'l', and one block
+	function call advances them all. The block functions are written
+	once, as macros, for GCC vector types - which become SSE2 code, or
+	AVX2 code in the copies compiled for it, picked at run time by
+	sugSetHash() as the kernels are.
+*/
+
+/* passwords hashed at once by the vector SHA-256 and SHA-512 code */
+#define LANES_256 8
+#define LANES_512 4
+/* passwords hashed in one go by sugHashBatch() - grouped into lanes */
+#define HASH_WINDOW 64
+/* characters of random salt in each hash - and bytes for PBKDF2 */
+#define SALT_CHARS 16
+#define SALT_BYTES 16
+/* rounds used when none are given - the defaults of crypt(3) and passlib */
+#define SHA512_CRYPT_ROUNDS 5000
+#define PBKDF2_ROUNDS 29000
+/* most rounds allowed - the limit of SHA-512-crypt */
+#define HASH_ROUNDS_MAX 999999999UL
+
+typedef uint32_t v8u32 __attribute__((vector_size(32)));
+typedef uint64_t v4u64 __attribute__((vector_size(32)));
+
+static const uint32_t sha256K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+static const uint32_t sha256Init[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+static const uint64_t sha512K[80] = {
+	0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+	0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+	0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+	0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+	0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+	0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+	0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+	0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+	0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+	0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+	0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+	0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+	0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+	0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+	0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+	0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+	0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+	0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+	0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+	0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL };
+
+static const uint64_t sha512Init[8] = {
+	0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+	0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL };
+
+#define ROTR32(v,n) (((v) >> (n)) | ((v) << (32 - (n))))
+#define ROTR64(v,n) (((v) >> (n)) | ((v) << (64 - (n))))
+
+/*
+	the SHA-256 and SHA-512 block functions (FIPS 180-4) on the state
+	'h' of 8 values of type T, with the message block in 'w' (16 values,
+	overwritten - the schedule is kept as the last 16 words only). T is
+	a plain integer, or a vector of one per password.
+*/
+#define SHA256_ROUNDS(T, h, w) do { \
+	T a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7]; \
+	for (int i = 0; i < 64; i++) \
+	{ \
+		if (i >= 16) \
+		{ \
+			T s0 = w[(i-15) & 15], s1 = w[(i-2) & 15]; \
+			w[i & 15] += (ROTR32(s0, 7) ^ ROTR32(s0, 18) ^ (s0 >> 3)) + w[(i-7) & 15] + \
+			             (ROTR32(s1, 17) ^ ROTR32(s1, 19) ^ (s1 >> 10)); \
+		} \
+		T t1 = k + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + (g ^ (e & (f ^ g))) + sha256K[i] + w[i & 15]; \
+		T t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) | (c & (a | b))); \
+		k = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2; \
+	} \
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += k; \
+} while (0)
+
+#define SHA512_ROUNDS(T, h, w) do { \
+	T a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7]; \
+	for (int i = 0; i < 80; i++) \
+	{ \
+		if (i >= 16) \
+		{ \
+			T s0 = w[(i-15) & 15], s1 = w[(i-2) & 15]; \
+			w[i & 15] += (ROTR64(s0, 1) ^ ROTR64(s0, 8) ^ (s0 >> 7)) + w[(i-7) & 15] + \
+			             (ROTR64(s1, 19) ^ ROTR64(s1, 61) ^ (s1 >> 6)); \
+		} \
+		T t1 = k + (ROTR64(e, 14) ^ ROTR64(e, 18) ^ ROTR64(e, 41)) + (g ^ (e & (f ^ g))) + sha512K[i] + w[i & 15]; \
+		T t2 = (ROTR64(a, 28) ^ ROTR64(a, 34) ^ ROTR64(a, 39)) + ((a & b) | (c & (a | b))); \
+		k = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2; \
+	} \
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += k; \
+} while (0)
+
+static inline uint32_t load32be(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline uint64_t load64be(const unsigned char *p)
+{
+	return ((uint64_t)load32be(p) << 32) | load32be(p + 4);
+}
+
+static inline void store32be(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);  p[3] = (unsigned char)v;
+}
+
+static inline void store64be(unsigned char *p, uint64_t v)
+{
+	store32be(p, (uint32_t)(v >> 32));
+	store32be(p + 4, (uint32_t)v);
+}
+
+/**-------- FUNCTION: sha256Block / sha512Block
+
+   add one message block 'blk' (64 or 128 bytes) to the hash state 'h'
+
+*/
+
+static void sha256Block(uint32_t h[8], const unsigned char *blk)
+{
+	uint32_t w[16];
+	for (int i = 0; i < 16; i++) w[i] = load32be(blk + (4 * i));
+	SHA256_ROUNDS(uint32_t, h, w);
+}
+
+static void sha512Block(uint64_t h[8], const unsigned char *blk)
+{
+	uint64_t w[16];
+	for (int i = 0; i < 16; i++) w[i] = load64be(blk + (8 * i));
+	SHA512_ROUNDS(uint64_t, h, w);
+}
+
+/**-------- FUNCTION: sha256x8Block / sha512x4Block
+
+   the block functions for 8 (or 4) passwords at once: lane 'l' of
+   'h' and 'w' is the state and message word of password 'l'. The
+   AVX2 copies are the same code compiled for AVX2.
+
+*/
+
+static void sha256x8Block(v8u32 h[8], v8u32 w[16])
+{
+	SHA256_ROUNDS(v8u32, h, w);
+}
+
+static void sha512x4Block(v4u64 h[8], v4u64 w[16])
+{
+	SHA512_ROUNDS(v4u64, h, w);
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("avx2")))
+static void sha256x8BlockAVX2(v8u32 h[8], v8u32 w[16])
+{
+	SHA256_ROUNDS(v8u32, h, w);
+}
+
+__attribute__((target("avx2")))
+static void sha512x4BlockAVX2(v4u64 h[8], v4u64 w[16])
+{
+	SHA512_ROUNDS(v4u64, h, w);
+}
+#endif
+
+/*
+	table of the multi buffer block functions - the first the CPU can
+	run is used by sugSetHash()
+*/
+struct hashKernel {
+	const char *name;
+	void (*sha256x8)(v8u32 h[8], v8u32 w[16]);
+	void (*sha512x4)(v4u64 h[8], v4u64 w[16]);
+};
+static const hashKernel hashKernelTable[] = {
+#ifdef HAVE_X86_SIMD
+	{ "avx2",   sha256x8BlockAVX2, sha512x4BlockAVX2 },
+#endif
+	{ "vector", sha256x8Block,     sha512x4Block },
+};
+
+/*
+	shaStream is a SHA-256 or SHA-512 hash that is added to a piece at
+	a time - 'wide' is set for SHA-512. Used for the parts of the hashes
+	made once per password, where speed matters less.
+*/
+typedef struct {
+	int wide;                 // 1 == SHA-512 (128 byte blocks)
+	uint32_t h32[8];          // SHA-256 state
+	uint64_t h64[8];          // SHA-512 state
+	unsigned char buf[128];   // part block not yet added
+	size_t fill;              // bytes in 'buf'
+	uint64_t total;           // bytes added so far
+} shaStream;
+
+static void shaStart(shaStream *s, int wide)
+{
+	s->wide = wide;
+	memcpy(s->h32, sha256Init, sizeof(s->h32));
+	memcpy(s->h64, sha512Init, sizeof(s->h64));
+	s->fill = 0;
+	s->total = 0;
+}
+
+static void shaAdd(shaStream *s, const void *msg, size_t len)
+{
+	const unsigned char *p = msg;
+	size_t blk = s->wide ? 128 : 64;
+	s->total += len;
+	while (len > 0)
+	{
+		size_t n = blk - s->fill;
+		if (n > len) n = len;
+		memcpy(s->buf + s->fill, p, n);
+		s->fill += n; p += n; len -= n;
+		if (s->fill == blk)
+		{
+			if (s->wide) sha512Block(s->h64, s->buf); else sha256Block(s->h32, s->buf);
+			s->fill = 0;
+		}
+	}
+}
+
+/* finish the hash into 'out' - 32 or 64 bytes */
+static void shaEnd(shaStream *s, unsigned char *out)
+{
+	// the length is 8 bytes at the end of a SHA-256 block, and 16 bytes
+	// (the top 8 always 0 here) at the end of a SHA-512 one
+	size_t lenBytes = s->wide ? 16 : 8, lenAt = (s->wide ? 128 : 64) - lenBytes;
+	uint64_t bits = s->total * 8;
+	unsigned char pad = 0x80;
+	shaAdd(s, &pad, 1);
+	pad = 0;
+	while (s->fill != lenAt) shaAdd(s, &pad, 1);
+	unsigned char len[16] = { 0 };
+	store64be(len + lenBytes - 8, bits);
+	shaAdd(s, len, lenBytes);
+	for (int i = 0; i < 8; i++)
+	{
+		if (s->wide) store64be(out + (8 * i), s->h64[i]); else store32be(out + (4 * i), s->h32[i]);
+	}
+}
+
+/*
+	hashJob is one password to hash - its salt, and the hash made
+*/
+typedef struct {
+	const char *pw;                  // the password - not NUL terminated
+	size_t len;                      // characters in 'pw'
+	unsigned char salt[SALT_BYTES];  // PBKDF2 salt - or crypt salt characters
+	char hash[SUG_HASH_MAX + 1];     // the finished hash string
+} hashJob;
+
+/* crypt(3) and passlib base 64 alphabets */
+static const char cryptB64[] = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+static const char ab64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789./";
+
+/**-------- FUNCTION: ab64Encode
+
+   the 'len' bytes at 'in' as passlib's "adapted base 64" - standard
+   base 64 with '.' for '+' and no '=' padding - at 'out', with a NUL.
+   Returns the characters written.
+
+*/
+
+static size_t ab64Encode(const unsigned char *in, size_t len, char *out)
+{
+	size_t o = 0;
+	for (size_t i = 0; i < len; i += 3)
+	{
+		uint32_t v = (uint32_t)in[i] << 16;
+		if (i + 1 < len) v |= (uint32_t)in[i+1] << 8;
+		if (i + 2 < len) v |= in[i+2];
+		size_t chars = (len - i) >= 3 ? 4 : (len - i) + 1;
+		for (size_t c = 0; c < chars; c++) out[o++] = ab64[(v >> (18 - (6 * c))) & 63];
+	}
+	out[o] = '\0';
+	return o;
+}
+
+/**-------- FUNCTION: pbkdf2Lanes
+
+   PBKDF2-HMAC-SHA256 (RFC 8018) of the 'n' (1 to LANES_256) passwords
+   in 'job' - one 32 byte block of output each. The HMAC inner and
+   outer states of each password's key are worked out once, so every
+   round is then just two block functions - done for all the lanes at
+   once. Lanes past 'n' repeat the first password.
+
+*/
+
+static void pbkdf2Lanes(const sugContext *ctx, hashJob *job, int n)
+{
+	v8u32 ist[8], ost[8], u[8], t[8];
+	for (int l = 0; l < LANES_256; l++)
+	{
+		const hashJob *j = &job[l < n ? l : 0];
+		unsigned char key[64], pad[64], first[32];
+		memset(key, 0, sizeof(key));
+		if (j->len > sizeof(key))
+		{
+			shaStream s;
+			shaStart(&s, 0);
+			shaAdd(&s, j->pw, j->len);
+			shaEnd(&s, key);
+		}
+		else
+		{
+			memcpy(key, j->pw, j->len);
+		}
+		uint32_t in32[8], out32[8];
+		memcpy(in32, sha256Init, sizeof(in32));
+		memcpy(out32, sha256Init, sizeof(out32));
+		for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x36;
+		sha256Block(in32, pad);
+		for (int i = 0; i < 64; i++) pad[i] = key[i] ^ 0x5c;
+		sha256Block(out32, pad);
+
+		// the first round: HMAC(password, salt + block number 1)
+		shaStream s;
+		shaStart(&s, 0);
+		memcpy(s.h32, in32, sizeof(in32));
+		s.total = 64;
+		static const unsigned char blockOne[4] = { 0, 0, 0, 1 };
+		shaAdd(&s, j->salt, SALT_BYTES);
+		shaAdd(&s, blockOne, sizeof(blockOne));
+		shaEnd(&s, first);
+		shaStart(&s, 0);
+		memcpy(s.h32, out32, sizeof(out32));
+		s.total = 64;
+		shaAdd(&s, first, sizeof(first));
+		shaEnd(&s, first);
+
+		for (int i = 0; i < 8; i++)
+		{
+			ist[i][l] = in32[i];
+			ost[i][l] = out32[i];
+			u[i][l] = t[i][l] = load32be(first + (4 * i));
+		}
+	}
+
+	// the other rounds: each HMAC is of the 32 bytes of the one before -
+	// so each of its two blocks is the 32 bytes, padding and a length
+	// of 64 + 32 bytes, as the key block came first
+	for (unsigned long r = 1; r < ctx->hashRounds; r++)
+	{
+		v8u32 w[16], h[8];
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (int i = 0; i < 8; i++) { w[i] = u[i]; h[i] = pass ? ost[i] : ist[i]; }
+			w[8] = (v8u32){0} + 0x80000000u;
+			for (int i = 9; i < 15; i++) w[i] = (v8u32){0};
+			w[15] = (v8u32){0} + ((64 + 32) * 8);
+			ctx->hashKern->sha256x8(h, w);
+			for (int i = 0; i < 8; i++) u[i] = h[i];
+		}
+		for (int i = 0; i < 8; i++) t[i] ^= u[i];
+	}
+
+	for (int l = 0; l < n; l++)
+	{
+		unsigned char dk[32];
+		for (int i = 0; i < 8; i++) store32be(dk + (4 * i), t[i][l]);
+		char salt64[2 * SALT_BYTES], dk64[2 * sizeof(dk)];
+		ab64Encode(job[l].salt, SALT_BYTES, salt64);
+		ab64Encode(dk, sizeof(dk), dk64);
+		snprintf(job[l].hash, sizeof(job[l].hash), "$pbkdf2-sha256$%lu$%s$%s", ctx->hashRounds, salt64, dk64);
+	}
+}
+
+/**-------- FUNCTION: cryptRoundMessage
+
+   the message hashed by round 'r' of SHA-512-crypt for one password,
+   padded into whole blocks at 'out' - 'a' is the last round's hash,
+   'p' and 's' the password and salt sequences. Returns the number of
+   128 byte blocks.
+
+*/
+
+static int cryptRoundMessage(unsigned long r, const unsigned char *a, const unsigned char *p, size_t pl,
+	const unsigned char *s, size_t sl, unsigned char *out)
+{
+	size_t m = 0;
+	if (r & 1) { memcpy(out, p, pl); m = pl; } else { memcpy(out, a, 64); m = 64; }
+	if (r % 3) { memcpy(out + m, s, sl); m += sl; }
+	if (r % 7) { memcpy(out + m, p, pl); m += pl; }
+	if (r & 1) { memcpy(out + m, a, 64); m += 64; } else { memcpy(out + m, p, pl); m += pl; }
+	int blocks = (int)((m + 17 + 127) / 128);
+	size_t end = (size_t)blocks * 128;
+	out[m] = 0x80;
+	memset(out + m + 1, 0, end - m - 9);
+	store64be(out + end - 8, (uint64_t)m * 8);
+	return blocks;
+}
+
+/**-------- FUNCTION: sha512CryptLanes
+
+   SHA-512-crypt (as specified by Ulrich Drepper for glibc) of the 'n'
+   (1 to LANES_512) passwords in 'job', which must all be the same
+   length. The setup hashes are made for each password in turn; the
+   rounds - where the time goes - are done for all the lanes at once,
+   as with passwords of the same length every round hashes the same
+   number of bytes in each lane. One password on its own is hashed
+   with the plain block function.
+
+*/
+
+static int sha512CryptLanes(sugContext *ctx, hashJob *job, int n)
+{
+	size_t pl = job[0].len, sl = SALT_CHARS;
+	// each round's message is at most 64 + 2 * len(P) + len(S) bytes, and padding
+	size_t msgLen = 64 + (2 * pl) + sl + 128;
+	unsigned char *space = sugMalloc(LANES_512 * (pl + msgLen));
+	if (space == NULL) return setError(ctx->error, "unable to allocate memory to hash passwords");
+	unsigned char *p[LANES_512], *msg[LANES_512];
+	for (int l = 0; l < LANES_512; l++)
+	{
+		p[l] = space + (l * (pl + msgLen));
+		msg[l] = p[l] + pl;
+	}
+	unsigned char a[LANES_512][64], s[LANES_512][SALT_CHARS], dp[64], ds[64];
+	for (int l = 0; l < LANES_512; l++)
+	{
+		const hashJob *j = &job[l < n ? l : 0];
+		const unsigned char *pw = (const unsigned char *)j->pw;
+		shaStream alt, main;
+
+		// B = H(P S P) ; A = H(P S B... bits of len(P))
+		shaStart(&alt, 1);
+		shaAdd(&alt, pw, pl); shaAdd(&alt, j->salt, sl); shaAdd(&alt, pw, pl);
+		unsigned char b[64];
+		shaEnd(&alt, b);
+		shaStart(&main, 1);
+		shaAdd(&main, pw, pl); shaAdd(&main, j->salt, sl);
+		size_t cnt;
+		for (cnt = pl; cnt > 64; cnt -= 64) shaAdd(&main, b, 64);
+		shaAdd(&main, b, cnt);
+		for (cnt = pl; cnt > 0; cnt >>= 1)
+		{
+			if (cnt & 1) shaAdd(&main, b, 64); else shaAdd(&main, pw, pl);
+		}
+		shaEnd(&main, a[l]);
+
+		// the password sequence - from H(P repeated len(P) times)
+		shaStart(&alt, 1);
+		for (cnt = 0; cnt < pl; cnt++) shaAdd(&alt, pw, pl);
+		shaEnd(&alt, dp);
+		for (cnt = 0; cnt < pl; cnt++) p[l][cnt] = dp[cnt % 64];
+
+		// the salt sequence - from H(S repeated 16 + A[0] times)
+		shaStart(&alt, 1);
+		for (cnt = 0; cnt < 16u + a[l][0]; cnt++) shaAdd(&alt, j->salt, sl);
+		shaEnd(&alt, ds);
+		memcpy(s[l], ds, sl);
+	}
+
+	// the rounds
+	for (unsigned long r = 0; r < ctx->hashRounds; r++)
+	{
+		if (n == 1)
+		{
+			uint64_t h[8];
+			memcpy(h, sha512Init, sizeof(h));
+			int blocks = cryptRoundMessage(r, a[0], p[0], pl, s[0], sl, msg[0]);
+			for (int b = 0; b < blocks; b++) sha512Block(h, msg[0] + (128 * b));
+			for (int i = 0; i < 8; i++) store64be(a[0] + (8 * i), h[i]);
+			continue;
+		}
+		v4u64 h[8], w[16];
+		int blocks = 0;
+		for (int l = 0; l < LANES_512; l++) blocks = cryptRoundMessage(r, a[l], p[l], pl, s[l], sl, msg[l]);
+		for (int i = 0; i < 8; i++) h[i] = (v4u64){0} + sha512Init[i];
+		for (int b = 0; b < blocks; b++)
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				for (int l = 0; l < LANES_512; l++) w[i][l] = load64be(msg[l] + (128 * b) + (8 * i));
+			}
+			ctx->hashKern->sha512x4(h, w);
+		}
+		for (int l = 0; l < LANES_512; l++)
+		{
+			for (int i = 0; i < 8; i++) store64be(a[l] + (8 * i), h[i][l]);
+		}
+	}
+
+	// the hash bytes are output 3 at a time, in a set order - then the last on its own
+	static const unsigned char order[21][3] = {
+		{ 0, 21, 42}, {22, 43,  1}, {44,  2, 23}, { 3, 24, 45}, {25, 46,  4}, {47,  5, 26},
+		{ 6, 27, 48}, {28, 49,  7}, {50,  8, 29}, { 9, 30, 51}, {31, 52, 10}, {53, 11, 32},
+		{12, 33, 54}, {34, 55, 13}, {56, 14, 35}, {15, 36, 57}, {37, 58, 16}, {59, 17, 38},
+		{18, 39, 60}, {40, 61, 19}, {62, 20, 41} };
+	for (int l = 0; l < n; l++)
+	{
+		char *out = job[l].hash;
+		int o = (ctx->hashRounds == SHA512_CRYPT_ROUNDS) ?
+			snprintf(out, SUG_HASH_MAX, "$6$%.*s$", SALT_CHARS, (const char *)job[l].salt) :
+			snprintf(out, SUG_HASH_MAX, "$6$rounds=%lu$%.*s$", ctx->hashRounds, SALT_CHARS, (const char *)job[l].salt);
+		for (int g = 0; g <= 21; g++)
+		{
+			uint32_t v = g < 21 ? ((uint32_t)a[l][order[g][0]] << 16) | ((uint32_t)a[l][order[g][1]] << 8) | a[l][order[g][2]] : a[l][63];
+			for (int c = 0; c < (g < 21 ? 4 : 2); c++, v >>= 6) out[o++] = cryptB64[v & 63];
+		}
+		out[o] = '\0';
+	}
+	free(space);
+	return 0;
+}
+
+/**-------- FUNCTION: byLength
+
+   qsort() compare of two hashJob pointers by password length - and
+   then by position, so the order is the same on every system
+
+*/
+
+static int byLength(const void *x, const void *y)
+{
+	const hashJob *a = *(hashJob *const *)x, *b = *(hashJob *const *)y;
+	if (a->len != b->len) return a->len < b->len ? -1 : 1;
+	return a < b ? -1 : (a > b);
+}
+
+/**-------- FUNCTION: hashJobs
+
+   give each of the 'n' jobs a random salt and hash it - in groups of
+   as many lanes as the hash has. SHA-512-crypt groups need passwords
+   of the same length, so the jobs are grouped by length. Returns -1
+   if the memory needed is not available.
+
+*/
+
+static int hashJobs(sugContext *ctx, hashJob *job, int n)
+{
+	if (rngSeed(&ctx->saltEng, ctx->error) != 0) return -1;
+	for (int i = 0; i < n; i++)
+	{
+		if (ctx->hash == HASH_PBKDF2_SHA256)
+		{
+			for (int b = 0; b < SALT_BYTES; b += 4)
+			{
+				uint32_t v = rngNext32(&ctx->saltEng);
+				memcpy(job[i].salt + b, &v, 4);
+			}
+		}
+		else
+		{
+			// 5 characters of 6 bits from each random value
+			for (int c = 0; c < SALT_CHARS; c += 5)
+			{
+				uint32_t v = rngNext32(&ctx->saltEng);
+				for (int k = c; k < c + 5 && k < SALT_CHARS; k++, v >>= 6) job[i].salt[k] = (unsigned char)cryptB64[v & 63];
+			}
+		}
+	}
+
+	if (ctx->hash == HASH_PBKDF2_SHA256)
+	{
+		for (int i = 0; i < n; i += LANES_256) pbkdf2Lanes(ctx, job + i, n - i < LANES_256 ? n - i : LANES_256);
+		return 0;
+	}
+
+	hashJob *sorted[HASH_WINDOW];
+	for (int i = 0; i < n; i++) sorted[i] = &job[i];
+	qsort(sorted, n, sizeof(sorted[0]), byLength);
+	for (int i = 0; i < n; )
+	{
+		// a run of up to LANES_512 of the same length - copied so the lanes are together
+		hashJob group[LANES_512];
+		int g = 0;
+		while (g < LANES_512 && i + g < n && sorted[i+g]->len == sorted[i]->len)
+		{
+			group[g] = *sorted[i+g];
+			g++;
+		}
+		if (sha512CryptLanes(ctx, group, g) != 0) return -1;
+		for (int k = 0; k < g; k++) memcpy(sorted[i+k]->hash, group[k].hash, sizeof(group[k].hash));
+		i += g;
+	}
+	return 0;
+}
+
+/* the hashes by name for sugSetHash() - and their default rounds */
+static const struct {
+	const char *name;
+	int kind;
+	unsigned long rounds;
+} hashTable[] = {
+	{ "sha512-crypt",  HASH_SHA512_CRYPT,  SHA512_CRYPT_ROUNDS },
+	{ "pbkdf2-sha256", HASH_PBKDF2_SHA256, PBKDF2_ROUNDS },
+};
+
+/**-------- FUNCTION: sugSetHash
+
+   add a salted hash to each password - see libsugpass.h. The salts
+   come from a random engine of their own, seeded from the operating
+   system even when the passwords are made from a seed: a salt only
+   has to differ from every other, and this way no salt can give away
+   anything about a password. The multi buffer kernel is the fastest
+   the CPU supports.
+
+*/
+
+int sugSetHash(sugContext *ctx, const char *name, unsigned long rounds)
+{
+	if (name == NULL || strcmp(name, "none") == 0)
+	{
+		ctx->hash = HASH_NONE;
+		return 0;
+	}
+	size_t i = 0, count = sizeof(hashTable)/sizeof(hashTable[0]);
+	while (i < count && strcmp(hashTable[i].name, name) != 0) i++;
+	if (i == count)
+	{
+		int n = snprintf(ctx->error, SUG_ERR_LEN, "unknown password hash '%s' - choose from:", name);
+		for (i = 0; i < count && n < SUG_ERR_LEN; i++)
+			n += snprintf(ctx->error + n, SUG_ERR_LEN - n, " %s", hashTable[i].name);
+		return -1;
+	}
+	unsigned long least = hashTable[i].kind == HASH_SHA512_CRYPT ? 1000 : 1;
+	if (rounds == 0) rounds = hashTable[i].rounds;
+	if (rounds < least || rounds > HASH_ROUNDS_MAX)
+	{
+		return setError(ctx->error, "rounds for %s must be %lu to %lu", name, least, HASH_ROUNDS_MAX);
+	}
+	if (rngInit(&ctx->saltEng, engineTable[0].name, ctx->error) != 0) return -1;
+	size_t k = 0;
+	while (!kernelSupported(hashKernelTable[k].name)) k++;
+	ctx->hashKern = &hashKernelTable[k];
+	ctx->hash = hashTable[i].kind;
+	ctx->hashRounds = rounds;
+	return 0;
+}
+
+/**-------- FUNCTION: sugHashLength
+
+   longest hash sugHashBatch() adds to a password - see libsugpass.h
+
+*/
+
+size_t sugHashLength(const sugContext *ctx)
+{
+	char digits[24];
+	size_t r = (size_t)snprintf(digits, sizeof(digits), "%lu", ctx->hashRounds);
+	switch (ctx->hash)
+	{
+	// $6$rounds=N$ salt $ 86 characters of hash
+	case HASH_SHA512_CRYPT:  return 3 + 7 + r + 1 + SALT_CHARS + 1 + 86;
+	// $pbkdf2-sha256$N$ salt $ 43 characters of hash
+	case HASH_PBKDF2_SHA256: return 15 + r + 1 + (((SALT_BYTES * 4) + 2) / 3) + 1 + 43;
+	default:                 return 0;
+	}
+}
+
+/**-------- FUNCTION: sugHashBatch
+
+   add a hash to each password line in 'in' - see libsugpass.h. The
+   lines are hashed HASH_WINDOW at a time, which is enough to fill the
+   lanes even when lengths vary.
+
+*/
+
+long long sugHashBatch(sugContext *ctx, const char *in, size_t len, char *out, size_t outLen, size_t *used)
+{
+	*used = 0;
+	if (ctx->hash == HASH_NONE) return setError(ctx->error, "no password hash is set");
+	const char *end = in + len;
+	size_t lines = 0, extra = sugHashLength(ctx) + 1;
+	for (const char *p = in; p < end; lines++)
+	{
+		const char *eol = memchr(p, '\n', end - p);
+		p = eol ? eol + 1 : end;
+	}
+	if (len + 1 + (lines * extra) > outLen)
+	{
+		return setError(ctx->error, "no room for the hashes of %zu passwords in %zu bytes", lines, outLen);
+	}
+
+	hashJob job[HASH_WINDOW];
+	size_t o = 0;
+	for (const char *p = in; p < end; )
+	{
+		int n = 0;
+		for (; n < HASH_WINDOW && p < end; n++)
+		{
+			const char *eol = memchr(p, '\n', end - p);
+			if (eol == NULL) eol = end;
+			job[n].pw = p;
+			job[n].len = (size_t)(eol - p);
+			p = eol < end ? eol + 1 : end;
+		}
+		STAT_START(th);
+		if (hashJobs(ctx, job, n) != 0) return -1;
+		STAT_STOP(th, cyclesHash);
+		STAT_ADD(hashes, n);
+		for (int i = 0; i < n; i++)
+		{
+			size_t hl = strlen(job[i].hash);
+			memcpy(out + o, job[i].pw, job[i].len);
+			o += job[i].len;
+			out[o++] = '\t';
+			memcpy(out + o, job[i].hash, hl);
+			o += hl;
+			out[o++] = '\n';
+		}
+	}
+	*used = o;
+	return (long long)lines;
+}
+
+
+/*-----------------------*/
+/* CONTEXTS              */
+/*-----------------------*/
+
+/**-------- FUNCTION: dictShare / dictDrop
+
+   count another context as using dictionary 'd' - or one fewer, and
+   free it once no context uses it
+
+*/
+
+static wordDict *dictShare(wordDict *d)
+{
+	atomic_fetch_add(&d->refs, 1);
+	return d;
+}
+
+static void dictDrop(wordDict *d)
+{
+	if (d == NULL || d == &builtinDict) return;
+	if (atomic_fetch_sub(&d->refs, 1) == 1)
+	{
+		dictRelease(d);
+		free(d);
+	}
+}
+
+/**-------- FUNCTION: blockDrop
+
+   count one fewer context as using the blocklist 'b' - and unmap it
+   once no context uses it
+
+*/
+
+static void blockDrop(blockList *b)
+{
+	if (b == NULL) return;
+	if (atomic_fetch_sub(&b->refs, 1) == 1)
+	{
+		unmapFile(b->map, b->mapSize);
+		free(b);
+	}
+}
+
+/**-------- FUNCTION: markovNew / markovDrop
+
+   a new markov model trained from the dictionary 'd', used by one
+   context - or NULL with a message in 'err'. And count one fewer
+   context as using the model 'm', freeing it once none do.
+
+*/
+
+static markovModel *markovNew(const wordDict *d, char *err)
+{
+	markovModel *m = sugMalloc(sizeof(markovModel));
+	if (m == NULL)
+	{
+		setError(err, "unable to allocate memory for the markov model");
+		return NULL;
+	}
+	if (markovBuild(d, m, err) != 0)
+	{
+		free(m);
+		return NULL;
+	}
+	atomic_init(&m->refs, 1);
+	return m;
+}
+
+static void markovDrop(markovModel *m)
+{
+	if (m == NULL) return;
+	if (atomic_fetch_sub(&m->refs, 1) == 1) free(m);
+}
+
+/**-------- FUNCTION: sugCreate
+
+   make a new context - see libsugpass.h for its settings
+
+*/
+
+sugContext *sugCreate(void)
+{
+	sugContext *ctx = sugMalloc(sizeof(sugContext));
+	if (ctx == NULL) return NULL;
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->dict = &builtinDict;
+	ctx->nWords = ctx->wordsFloor = 4;
+	if (rngInit(&ctx->eng, engineTable[0].name, ctx->error) != 0 || sugSetKernel(ctx, NULL) != 0)
+	{
+		free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+/**-------- FUNCTION: sugClone
+
+   make a new context with the settings of 'ctx' that shares its
+   dictionary, blocklist and markov model - only the random engine is
+   new, seeded on its own. A seeded engine is copied instead, so the
+   new context makes the same run of passwords - use sugSeek() to make
+   a different part. The engine for hash salts is always new.
+
+*/
+
+sugContext *sugClone(const sugContext *ctx)
+{
+	sugContext *c = sugMalloc(sizeof(sugContext));
+	if (c == NULL) return NULL;
+	*c = *ctx;
+	if ((!ctx->eng.seeded && rngInit(&c->eng, ctx->eng.name, c->error) != 0) ||
+		(ctx->hash != HASH_NONE && rngInit(&c->saltEng, engineTable[0].name, c->error) != 0))
+	{
+		free(c);
+		return NULL;
+	}
+	c->dict = dictShare(ctx->dict);
+	if (c->block) atomic_fetch_add(&c->block->refs, 1);
+	if (c->markov) atomic_fetch_add(&c->markov->refs, 1);
+	return c;
+}
+
+void sugFree(sugContext *ctx)
+{
+	if (ctx == NULL) return;
+	dictDrop(ctx->dict);
+	blockDrop(ctx->block);
+	markovDrop(ctx->markov);
+	free(ctx);
+}
+
+const char *sugError(const sugContext *ctx)
+{
+	return ctx->error;
+}
+
+/**-------- FUNCTION: sugSetEngine
+
+   switch the context to the random engine called 'name' - freshly
+   seeded. The engine in use is kept if 'name' is not known.
+
+*/
+
+int sugSetEngine(sugContext *ctx, const char *name)
+{
+	return rngInit(&ctx->eng, name, ctx->error);
+}
+
+/**-------- FUNCTION: sugSetSeed / sugSeek / sugTell
+
+   make the engine's output depend only on 'seed' - see libsugpass.h.
+   The 256 bit ChaCha20 key is the SHA-1 hash of the seed followed by
+   the first 12 bytes of the SHA-1 hash of that - so the key has up to
+   160 bits of entropy, from however long a seed. Then choose which
+   password of the run is made next, or find out.
+
+*/
+
+int sugSetSeed(sugContext *ctx, const char *seed)
+{
+	randEngine *eng = &ctx->eng;
+	if (eng->refill != chachaRefill && eng->refill != chachaSeekRefill)
+	{
+		return setError(ctx->error, "a seed can only be used with the chacha20 random engine - not '%s'", eng->name);
+	}
+	unsigned char h1[SBL_HASH_LEN], h2[SBL_HASH_LEN];
+	sha1(seed, strlen(seed), h1);
+	sha1(h1, sizeof(h1), h2);
+	unsigned char key[sizeof(eng->key)];
+	memcpy(key, h1, sizeof(h1));
+	memcpy(key + sizeof(h1), h2, sizeof(key) - sizeof(h1));
+	// key words are little endian - so a seed gives the same passwords on every computer
+	for (int i = 0; i < 8; i++)
+	{
+		eng->key[i] = (uint32_t)key[4*i] | ((uint32_t)key[4*i+1] << 8) |
+		              ((uint32_t)key[4*i+2] << 16) | ((uint32_t)key[4*i+3] << 24);
+	}
+	eng->refill = chachaSeekRefill;
+	eng->seeded = 1;
+	eng->needSeed = 0;
+	eng->next = 0;
+	eng->pos = RNG_BUF_WORDS;
+	return 0;
+}
+
+void sugSeek(sugContext *ctx, uint64_t n) { ctx->eng.next = n; }
+uint64_t sugTell(const sugContext *ctx) { return ctx->eng.next; }
+
+/**-------- FUNCTION: sugSetKernel
+
+   pick the password assembly kernel called 'name' - or if 'name' is
+   NULL the fastest one the CPU supports. Returns -1 if the name is
+   unknown or the CPU cannot run it.
+
+*/
+
+int sugSetKernel(sugContext *ctx, const char *name)
+{
+	for (size_t i = 0; i < kernelCount; i++)
+	{
+		if (name ? strcmp(kernelTable[i].name, name) == 0 : kernelSupported(kernelTable[i].name))
+		{
+			if (!kernelSupported(kernelTable[i].name))
+			{
+				return setError(ctx->error, "this CPU does not support the '%s' kernel", name);
+			}
+			ctx->assemble = kernelTable[i].fn;
+			ctx->kernel = kernelTable[i].name;
+			return 0;
+		}
+	}
+	int n = snprintf(ctx->error, SUG_ERR_LEN, "unknown kernel '%s' - choose from:", name);
+	for (size_t i = 0; i < kernelCount && n < SUG_ERR_LEN; i++)
+		n += snprintf(ctx->error + n, SUG_ERR_LEN - n, " %s", kernelTable[i].name);
+	return -1;
+}
+
+/**-------- FUNCTION: dictReplace
+
+   make the new dictionary 'd' the context's in place of the one it
+   had - with a markov model trained again from it if the context has
+   one - unless the policy no longer fits, when 'd' is freed and the
+   old one kept
+
+*/
+
+static int dictReplace(sugContext *ctx, wordDict *d)
+{
+	atomic_init(&d->refs, 1);
+	markovModel *m = NULL;
+	if (ctx->markov && (m = markovNew(d, ctx->error)) == NULL)
+	{
+		dictDrop(d);
+		return -1;
+	}
+	wordDict *old = ctx->dict;
+	markovModel *oldMarkov = ctx->markov;
+	ctx->dict = d;
+	if (m) ctx->markov = m;
+	if (applyPolicy(ctx) != 0)
+	{
+		ctx->dict = old;
+		ctx->markov = oldMarkov;
+		markovDrop(m);
+		dictDrop(d);
+		return -1;
+	}
+	dictDrop(old);
+	if (m) markovDrop(oldMarkov);
+	return 0;
+}
+
+/**-------- FUNCTION: sugSetMode
+
+   make passwords from dictionary words ("words") or from a markov
+   model of the dictionary's letters ("markov") - the model is trained
+   here, when the mode is chosen, and again if the dictionary changes.
+   The mode is kept if the policy does not fit the new one.
+
+*/
+
+int sugSetMode(sugContext *ctx, const char *name)
+{
+	markovModel *m = NULL;
+	if (name == NULL || strcmp(name, "words") == 0)
+	{
+		if (ctx->markov == NULL) return 0;
+	}
+	else if (strcmp(name, "markov") == 0)
+	{
+		if (ctx->markov) return 0;
+		if ((m = markovNew(ctx->dict, ctx->error)) == NULL) return -1;
+	}
+	else
+	{
+		return setError(ctx->error, "unknown mode '%s' - choose from: words markov", name);
+	}
+	markovModel *old = ctx->markov;
+	ctx->markov = m;
+	if (applyPolicy(ctx) != 0)
+	{
+		ctx->markov = old;
+		markovDrop(m);
+		return -1;
+	}
+	markovDrop(old);
+	return 0;
+}
+
+/**-------- FUNCTION: sugLoadWordList
+
+   load the word list file 'path' as the context's dictionary in place
+   of the one it had - then check the policy still fits it
+
+*/
+
+int sugLoadWordList(sugContext *ctx, const char *path)
+{
+	wordDict *d = sugMalloc(sizeof(wordDict));
+	if (d == NULL) return setError(ctx->error, "unable to allocate memory for word list '%s'", path);
+	if (dictFromFile(d, path, ctx->error) != 0)
+	{
+		free(d);
+		return -1;
+	}
+	return dictReplace(ctx, d);
+}
+
+/**-------- FUNCTION: sugExcludeWords
+
+   remove from the context's dictionary every word in the word list
+   file 'path' - eg words that should never appear in a password. The
+   words to remove are sorted (in lower case, so case is ignored) and
+   each dictionary word looked up in them once, then the words kept
+   are copied to a new dictionary in place of the old. Done once when
+   the dictionary is loaded, so it costs nothing per password.
+
+*/
+
+typedef struct {
+	const char *w;
+	uint32_t len;
+} wordRef;
+
+static int wordRefCmp(const void *a, const void *b)
+{
+	const wordRef *x = a, *y = b;
+	int c = memcmp(x->w, y->w, x->len < y->len ? x->len : y->len);
+	return c ? c : (int)x->len - (int)y->len;
+}
+
+int sugExcludeWords(sugContext *ctx, const char *path)
+{
+	wordDict ex;
+	if (dictFromFile(&ex, path, ctx->error) != 0) return -1;
+
+	// lower case copies of the words to exclude
+	const wordDict *old = ctx->dict;
+	size_t exChars = 0, oldChars = 0;
+	uint32_t len;
+	for (uint32_t i = 0; i < ex.count; i++) { dictWord(&ex, i, &len); exChars += len; }
+	for (uint32_t i = 0; i < old->count; i++) { dictWord(old, i, &len); oldChars += len; }
+	wordRef *ref = sugMalloc(sizeof(wordRef) * ex.count);
+	char *lower = sugMalloc(exChars);
+	wordDict *d = sugMalloc(sizeof(wordDict));
+	if (ref == NULL || lower == NULL || d == NULL || dictAlloc(d, old->count, oldChars) != 0)
+	{
+		free(ref); free(lower); free(d);
+		dictRelease(&ex);
+		return setError(ctx->error, "unable to allocate memory to exclude words in '%s'", path);
+	}
+	char *l = lower;
+	for (uint32_t i = 0; i < ex.count; i++)
+	{
+		const char *w = dictWord(&ex, i, &len);
+		for (uint32_t c = 0; c < len; c++) l[c] = (char)tolower((unsigned char)w[c]);
+		ref[i].w = l;
+		ref[i].len = len;
+		l += len;
+	}
+	uint32_t nEx = ex.count;
+	dictRelease(&ex);
+	qsort(ref, nEx, sizeof(wordRef), wordRefCmp);
+
+	// keep the words not found
+	char word[MAX_WORD_LEN];
+	for (uint32_t i = 0; i < old->count; i++)
+	{
+		const char *w = dictWord(old, i, &len);
+		for (uint32_t c = 0; c < len; c++) word[c] = (char)tolower((unsigned char)w[c]);
+		wordRef key = { word, len };
+		if (bsearch(&key, ref, nEx, sizeof(wordRef), wordRefCmp) == NULL) dictAdd(d, w, len);
+	}
+	free(ref); ref = NULL;
+	free(lower); lower = NULL;
+
+	if (d->count == 0)
+	{
+		dictRelease(d);
+		free(d);
+		return setError(ctx->error, "every word in the dictionary is in '%s'", path);
+	}
+	if (dictFinish(d) != 0)
+	{
+		dictRelease(d);
+		free(d);
+		return setError(ctx->error, "unable to allocate memory to exclude words in '%s'", path);
+	}
+	return dictReplace(ctx, d);
+}
+
+/**-------- FUNCTION: sugLoadBlocklist
+
+   map the blocklist file 'path' (made by '--compile-blocklist') for
+   the context to check each password against - see blockList. The
+   header is checked so the filter and hashes lie inside the file, but
+   the hashes themselves are not read: loading takes the same time
+   however large the file is. The kernel is asked to read the Bloom
+   filter in straight away, and not to read ahead in the hashes, as
+   they are only read a page here and there.
+
+*/
+
+int sugLoadBlocklist(sugContext *ctx, const char *path)
+{
+	size_t size = 0;
+	ctx->error[0] = '\0';
+	const char *map = mapFile(path, &size, ctx->error);
+	if (map == NULL)
+	{
+		return ctx->error[0] ? -1 : setError(ctx->error, "blocklist '%s' is empty", path);
+	}
+	sblHeader h;
+	const char *problem = NULL;
+	if (size < SBL_HEADER_SIZE || memcmp(map, SBL_MAGIC, 4) != 0)
+	{
+		problem = "is not a blocklist - make one with --compile-blocklist";
+	}
+	else
+	{
+		memcpy(&h, map, sizeof(h));
+		if (h.version != SBL_VERSION || h.byteOrder != SWL_BYTE_ORDER)
+		{
+			problem = "is another version or from a computer with a different byte order"
+				" - recreate it with --compile-blocklist";
+		}
+		else if (h.count == 0 || h.bloomBlocks == 0 || (h.bloomBlocks & (h.bloomBlocks - 1)) != 0 ||
+			h.bloomOffset != SBL_HEADER_SIZE || h.bloomBlocks > (size - h.bloomOffset) / 64 ||
+			h.hashOffset < h.bloomOffset + (h.bloomBlocks * 64) || h.hashOffset > size ||
+			h.count > (size - h.hashOffset) / SBL_HASH_LEN)
+		{
+			problem = "has an invalid header";
+		}
+	}
+	blockList *b = problem ? NULL : sugMalloc(sizeof(blockList));
+	if (b == NULL)
+	{
+		unmapFile(map, size);
+		return setError(ctx->error, "blocklist '%s' %s", path, problem ? problem : "could not be loaded - out of memory");
+	}
+	b->bloom = (const uint64_t *)(map + h.bloomOffset);
+	b->bloomMask = h.bloomBlocks - 1;
+	b->hash = (const unsigned char *)(map + h.hashOffset);
+	b->count = h.count;
+	b->map = map;
+	b->mapSize = size;
+	atomic_init(&b->refs, 1);
+#if !defined(_WIN32) && defined(MADV_WILLNEED)
+	madvise((void *)map, size, MADV_RANDOM);
+	madvise((void *)map, h.hashOffset, MADV_WILLNEED);
+#endif
+	blockDrop(ctx->block);
+	ctx->block = b;
+	ctx->failed = 0;
+	return 0;
+}
+
+int sugSetWords(sugContext *ctx, int nWords)
+{
+	if (nWords < 1) return setError(ctx->error, "words per password must be 1 or more - not %d", nWords);
+	int old = ctx->wordsFloor;
+	ctx->wordsFloor = nWords;
+	if (applyPolicy(ctx) != 0)
+	{
+		ctx->wordsFloor = old;
+		return -1;
+	}
+	return 0;
+}
+
+int sugSetPolicy(sugContext *ctx, const passPolicy *policy)
+{
+	passPolicy old = ctx->policy;
+	ctx->policy = *policy;
+	if (applyPolicy(ctx) != 0)
+	{
+		ctx->policy = old;
+		return -1;
+	}
+	return 0;
+}
+
+int sugWords(const sugContext *ctx) { return ctx->nWords; }
+uint32_t sugDictSize(const sugContext *ctx) { return ctx->dict->count; }
+double sugEntropy(const sugContext *ctx) { return policyEntropy(ctx, ctx->nWords); }
+size_t sugMaxLength(const sugContext *ctx) { return policyMaxLength(ctx, ctx->nWords); }
+const char *sugEngineName(const sugContext *ctx) { return ctx->eng.name; }
+const char *sugKernelName(const sugContext *ctx) { return ctx->kernel; }
+const char *sugModeName(const sugContext *ctx) { return ctx->markov ? "markov" : "words"; }
+
+/**-------- FUNCTION: sugGenerate
+
+   make one password - plain and, if wanted, with spaces - both NUL
+   terminated
+
+*/
+
+size_t sugGenerate(sugContext *ctx, char *plain, char *spaced)
+{
+	size_t slen = 0;
+	size_t len = generatePassword(ctx, plain, spaced, &slen);
+	plain[len] = '\0';
+	if (spaced) spaced[slen] = '\0';
+	return len;
+}
+
+/**-------- FUNCTION: sugGenerateBatch
+
+   make up to 'count' passwords one after another into 'buf', each
+   followed by 'term'. Each password is built straight into 'buf', so
+   there is no copying - generation stops once the space left might not
+   hold the longest password the context can make. Returns -1 if
+   generation failed - see generatePassword().
+
+*/
+
+long long sugGenerateBatch(sugContext *ctx, long long count, char term, char *buf, size_t bufLen, size_t *used)
+{
+	size_t lineLen = policyMaxLength(ctx, ctx->nWords) + 1;
+	char *line = buf;
+	char *end = buf + bufLen;
+	long long n = 0;
+	for (; n < count && (size_t)(end - line) >= lineLen; n++)
+	{
+		size_t slen;
+		line += generatePassword(ctx, line, NULL, &slen);
+		if (ctx->failed)
+		{
+			*used = (size_t)(line - buf);
+			return -1;
+		}
+		*line++ = term;
+	}
+	*used = (size_t)(line - buf);
+	return n;
+}
+
+
+
+/*-----------------------*/
+/* RECORD FORMATS        */
+/*-----------------------*/
+
+/* the record formats by name - and the line output before their records */
+static const struct {
+	const char *name;
+	int format;
+	const char *header;
+} formatTable[] = {
+	{ "raw",   FORMAT_RAW,   "" },
+	{ "nul",   FORMAT_NUL,   "" },
+	{ "csv",   FORMAT_CSV,   "password,spaced,entropy,index\n" },
+	{ "jsonl", FORMAT_JSONL, "" },
+};
+
+/* bytes of a csv or jsonl record besides its two forms of the password:
+   the field names and punctuation, the entropy and the 20 digit index */
+#define RECORD_FIXED 96
+
+/**-------- FUNCTION: sugSetFormat / sugFormatHeader
+
+   choose the format of sugFormatBatch() records by name - and the
+   header line for it
+
+*/
+
+int sugSetFormat(sugContext *ctx, const char *name)
+{
+	size_t i = 0, count = sizeof(formatTable)/sizeof(formatTable[0]);
+	if (name == NULL) name = formatTable[0].name;
+	while (i < count && strcmp(formatTable[i].name, name) != 0) i++;
+	if (i == count)
+	{
+		int n = snprintf(ctx->error, SUG_ERR_LEN, "unknown output format '%s' - choose from:", name);
+		for (i = 0; i < count && n < SUG_ERR_LEN; i++)
+			n += snprintf(ctx->error + n, SUG_ERR_LEN - n, " %s", formatTable[i].name);
+		return -1;
+	}
+	ctx->format = formatTable[i].format;
+	return 0;
+}
+
+const char *sugFormatHeader(const sugContext *ctx)
+{
+	for (size_t i = 0; i < sizeof(formatTable)/sizeof(formatTable[0]); i++)
+	{
+		if (formatTable[i].format == ctx->format) return formatTable[i].header;
+	}
+	return "";
+}
+
+/**-------- FUNCTION: sugRecordLength
+
+   bytes of the buffer sugFormatBatch() needs for each record. The two
+   forms of the password may each grow six times in a jsonl record (a
+   control character as \u00XX) or twice in a csv one (every '"' made
+   '""'), and the password is first made - plain then with spaces -
+   after the space for the record, at the end of the buffer
+
+*/
+
+size_t sugRecordLength(const sugContext *ctx)
+{
+	size_t plain = policyMaxLength(ctx, ctx->nWords);
+	size_t spaced = 2 * plain;
+	switch (ctx->format)
+	{
+	case FORMAT_CSV:   return (2 * (plain + spaced)) + 4 + RECORD_FIXED + plain + spaced + 2;
+	case FORMAT_JSONL: return (6 * (plain + spaced)) + RECORD_FIXED + plain + spaced + 2;
+	default:           return plain + 1;
+	}
+}
+
+/**-------- FUNCTION: jsonString / csvField / putDecimal
+
+   write the 'len' characters at 'in' to 'out' - escaped for a JSON
+   string (without the quotes round it), or as a csv field (quoted
+   only if it holds a ',', '"' or line end) - or the number 'v' in
+   decimal. Each returns the bytes written.
+
+*/
+
+static size_t jsonString(char *out, const char *in, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	char *o = out;
+	for (size_t i = 0; i < len; i++)
+	{
+		unsigned char ch = (unsigned char)in[i];
+		if (ch == '"' || ch == '\\')
+		{
+			*o++ = '\\';
+			*o++ = (char)ch;
+		}
+		else if (ch < 0x20)
+		{
+			memcpy(o, "\\u00", 4);
+			o[4] = hex[ch >> 4];
+			o[5] = hex[ch & 15];
+			o += 6;
+		}
+		else
+		{
+			*o++ = (char)ch;
+		}
+	}
+	return (size_t)(o - out);
+}
+
+static size_t csvField(char *out, const char *in, size_t len)
+{
+	size_t i = 0;
+	while (i < len && in[i] != ',' && in[i] != '"' && in[i] != '\n' && in[i] != '\r') i++;
+	if (i == len)
+	{
+		memcpy(out, in, len);
+		return len;
+	}
+	char *o = out;
+	*o++ = '"';
+	for (i = 0; i < len; i++)
+	{
+		if (in[i] == '"') *o++ = '"';
+		*o++ = in[i];
+	}
+	*o++ = '"';
+	return (size_t)(o - out);
+}
+
+static size_t putDecimal(char *out, uint64_t v)
+{
+	char digits[20];
+	size_t n = 0;
+	do
+	{
+		digits[n++] = (char)('0' + (v % 10));
+		v /= 10;
+	} while (v > 0);
+	for (size_t i = 0; i < n; i++) out[i] = digits[n - 1 - i];
+	return n;
+}
+
+/**-------- FUNCTION: sugFormatBatch
+
+   make up to 'count' passwords into 'buf' as records of the context's
+   format - see libsugpass.h. raw and nul records are made by
+   sugGenerateBatch(). For csv and jsonl each password is made, plain
+   and with spaces, in the space at the end of 'buf' that the records
+   have not reached - so nothing is allocated - then written into its
+   record with the entropy (worked out once for the batch) and its
+   number.
+
+*/
+
+long long sugFormatBatch(sugContext *ctx, long long count, char *buf, size_t bufLen, size_t *used)
+{
+	int csv = ctx->format == FORMAT_CSV;
+	if (!csv && ctx->format != FORMAT_JSONL)
+	{
+		return sugGenerateBatch(ctx, count, ctx->format == FORMAT_NUL ? '\0' : '\n', buf, bufLen, used);
+	}
+	size_t plainMax = policyMaxLength(ctx, ctx->nWords);
+	size_t recLen = sugRecordLength(ctx);
+	char entropy[32];
+	size_t eLen = (size_t)snprintf(entropy, sizeof(entropy), "%.2f", policyEntropy(ctx, ctx->nWords));
+	char *plain = buf + bufLen - ((3 * plainMax) + 2);
+	char *spaced = plain + plainMax + 1;
+	char *rec = buf, *end = buf + bufLen;
+	long long n = 0;
+	for (; n < count && (size_t)(end - rec) >= recLen; n++)
+	{
+		uint64_t index = ctx->eng.next;
+		size_t slen;
+		size_t plen = generatePassword(ctx, plain, spaced, &slen);
+		if (ctx->failed)
+		{
+			*used = (size_t)(rec - buf);
+			return -1;
+		}
+		if (csv)
+		{
+			rec += csvField(rec, plain, plen);
+			*rec++ = ',';
+			rec += csvField(rec, spaced, slen);
+			*rec++ = ',';
+			memcpy(rec, entropy, eLen);
+			rec += eLen;
+			*rec++ = ',';
+			rec += putDecimal(rec, index);
+		}
+		else
+		{
+			memcpy(rec, "{\"password\":\"", 13);
+			rec += 13;
+			rec += jsonString(rec, plain, plen);
+			memcpy(rec, "\",\"spaced\":\"", 12);
+			rec += 12;
+			rec += jsonString(rec, spaced, slen);
+			memcpy(rec, "\",\"entropy\":", 12);
+			rec += 12;
+			memcpy(rec, entropy, eLen);
+			rec += eLen;
+			memcpy(rec, ",\"index\":", 9);
+			rec += 9;
+			rec += putDecimal(rec, index);
+			*rec++ = '}';
+		}
+		*rec++ = '\n';
+	}
+	*used = (size_t)(rec - buf);
+	return n;
+}
+
+/**-------- FUNCTION: sugRecordPassword
+
+   find the password in a record made by sugFormatBatch() - the first
+   field of every format. A quoted csv field is taken with its quotes,
+   up to the '"' that is not doubled; a JSON string up to the '"' that
+   is not escaped.
+
+*/
+
+const char *sugRecordPassword(const sugContext *ctx, const char *rec, size_t len, size_t *pwLen)
+{
+	size_t i = 0;
+	switch (ctx->format)
+	{
+	case FORMAT_CSV:
+		if (len > 0 && rec[0] == '"')
+		{
+			for (i = 1; i < len; i++)
+			{
+				if (rec[i] != '"') continue;
+				if (i + 1 < len && rec[i+1] == '"') i++;
+				else { i++; break; }
+			}
+		}
+		else
+		{
+			while (i < len && rec[i] != ',') i++;
+		}
+		*pwLen = i;
+		return rec;
+	case FORMAT_JSONL:
+		if (len < 13)
+		{
+			*pwLen = len;
+			return rec;
+		}
+		rec += 13;
+		len -= 13;
+		while (i < len && rec[i] != '"') i += rec[i] == '\\' ? 2 : 1;
+		*pwLen = i < len ? i : len;
+		return rec;
+	default:
+		*pwLen = len;
+		return rec;
+	}
+}
@@ -0,0 +1,876 @@
+/**
+
+   Library: libsugpass
+
+   Created by Simon Rowe <simon@wiremoons.com>
+
+   Updated 17 Oct 2026 - password generation split out of sugpass.c
+   into this library so it can be used in process by other programs.
+
+   About
+
+   The password generation core of 'sugpass': dictionaries, random
+   engines, password policy and batch generation. All state is held in
+   a context (sugContext) - there are no global settings - so any
+   number of threads can generate passwords at the same time, each
+   with its own context. Contexts made with sugClone() share their
+   dictionary, so a large word list is only loaded once.
+
+   Example:
+
+	sugContext *ctx = sugCreate();
+	char buf[4096];
+	size_t used;
+	long long n = sugGenerateBatch(ctx, 100, '\n', buf, sizeof(buf), &used);
+	fwrite(buf, 1, used, stdout);
+	sugFree(ctx);
+
+   Functions returning int give 0 on success and -1 on failure - when
+   sugError() gives a message saying what went wrong. No function
+   prints anything or exits the program.
+
+   Build with: 'make lib' - which makes libsugpass.a and libsugpass.so
+
+   The library is licensed under the "MIT License" see
+   http://opensource.org/licenses/MIT for more details.
+
+*/
+
+#ifndef LIBSUGPASS_H
+#define LIBSUGPASS_H
+
+#include <stddef.h>	  // used for size_t
+#include <stdint.h>	  // used for fixed size uint32_t uint64_t
+
+/* the declarations down to INTERNALS are all the shared library exports
+   - 'make lib' builds it with -fvisibility=hidden, so its internals can
+   not clash with (or be replaced by) symbols of the program using it */
+#if defined(__GNUC__)
+#pragma GCC visibility push(default)
+#endif
+
+/* size of the buffer holding a context's last error message */
+#define SUG_ERR_LEN 256
+
+/* symbols one of which is added to passwords when a symbol is required */
+#define POLICY_SYMBOLS "!#$%&*+-=?@^_~"
+
+/*
+	passPolicy holds the rules passwords must meet - set by the long
+	command line options such as '--require'. Rules are met as each
+	password is built, by adding what is needed, so no password is
+	ever made and then thrown away for failing a rule:
+	    digit  - a random digit is put at a random word boundary
+	    symbol - a random POLICY_SYMBOLS symbol is put at a random
+	             word boundary (unless the separator is a symbol)
+	    upper  - the first letter of a random word is made uppercase
+	             (unless 'capitalise' already does every word)
+	See policyEntropy() for the entropy each of these adds.
+*/
+typedef struct {
+	double minEntropy;    // least bits of entropy wanted - 0 == no minimum
+	int maxLen;           // most characters in a password - 0 == no limit
+	int requireDigit;     // 1 == each password must contain a digit
+	int requireUpper;     // 1 == each password must contain an uppercase letter
+	int requireSymbol;    // 1 == each password must contain a symbol
+	int capitalise;       // 1 == first letter of every word is uppercase
+	char separator;       // character put between words - '\0' == none
+} passPolicy;
+
+/*
+	runStats holds the counters and timers reported by '--stats'. Each
+	thread counts into its own copy (threadStats) so no locking or
+	shared cache lines are needed on the hot path - copies are added
+	to the totals by sugStatsMerge() when a thread finishes. Timers are
+	in CPU cycles (or ns where there is no cycle counter) and are only
+	read when enabled with sugStatsEnable().
+*/
+typedef struct {
+	uint64_t passwords;      // passwords generated
+	uint64_t words;          // words selected
+	uint64_t rngRefills;     // random engine buffer refills
+	uint64_t rngBytes;       // random bytes produced by the engines
+	uint64_t rejections;     // values redrawn by rngUniform() to avoid bias
+	uint64_t duplicates;     // passwords replaced by '--unique' as already output
+	uint64_t blocked;        // passwords replaced as they are in the '--blocklist'
+	uint64_t hashes;         // passwords hashed for '--hash'
+	uint64_t syscalls;       // write() calls made
+	uint64_t bytesOut;       // bytes output by write()
+	uint64_t cyclesRng;      // time refilling random engine buffers
+	uint64_t cyclesSelect;   // time selecting words - includes cyclesRng
+	uint64_t cyclesFormat;   // time building passwords from the words
+	uint64_t cyclesOutput;   // time in write()
+	uint64_t cyclesHash;     // time hashing passwords
+} runStats;
+
+/* a password generator - see sugCreate() */
+typedef struct sugContext sugContext;
+
+/*-----------------------*/
+/* CONTEXTS              */
+/*-----------------------*/
+
+/* new context: built in three letter words, ChaCha20 engine seeded from
+   the OS, 4 words per password, no policy. NULL if it cannot be made */
+sugContext *sugCreate(void);
+/* new context with the same settings and dictionary as 'ctx', but its
+   own independently seeded random engine - for use by another thread */
+sugContext *sugClone(const sugContext *ctx);
+/* free a context - the dictionary is freed once no clone uses it */
+void sugFree(sugContext *ctx);
+/* message for the last failure of a function given 'ctx' */
+const char *sugError(const sugContext *ctx);
+
+/*-----------------------*/
+/* SETTINGS              */
+/*-----------------------*/
+
+/* random engine by name: "chacha20" (default) or "libc" (testing only) */
+int sugSetEngine(sugContext *ctx, const char *name);
+/* make the chacha20 engine's output depend only on the string 'seed' - so
+   the same seed and settings always make the same passwords. Password 'n'
+   of the run is made from its own ChaCha20 stream (nonce 'n'), so any
+   part of a run can be made on its own - see sugSeek(). Passwords are then
+   only as secret as the seed. Undone by sugSetEngine() */
+int sugSetSeed(sugContext *ctx, const char *seed);
+/* make password number 'n' of the run next - with a seed, so threads or
+   computers can each make their own part of one run. Without one it only
+   sets the number given to the next record - see sugFormatBatch() */
+void sugSeek(sugContext *ctx, uint64_t n);
+/* number of the password to be made next - counted from 0 (or the last
+   sugSeek()) with or without a seed */
+uint64_t sugTell(const sugContext *ctx);
+/* password assembly kernel by name: "avx2", "ssse3", "scalar" - or NULL
+   for the fastest the CPU supports */
+int sugSetKernel(sugContext *ctx, const char *name);
+/* how passwords are made, by name: "words" (dictionary words - the
+   default) or "markov" (pronounceable letters from a Markov chain of the
+   dictionary's letters - see markovModel). With "markov" each of the
+   sugWords() 'words' is a three letter syllable, and sugEntropy() is the
+   min-entropy: -log2 of the chance of the most likely password */
+int sugSetMode(sugContext *ctx, const char *name);
+/* load a word list - text or binary (see sugCompileWordList()) */
+int sugLoadWordList(sugContext *ctx, const char *path);
+/* words in each password - also the least used to meet a minimum entropy */
+int sugSetWords(sugContext *ctx, int nWords);
+/* rules each password must meet - may change the words per password */
+int sugSetPolicy(sugContext *ctx, const passPolicy *policy);
+
+/*-----------------------*/
+/* INFORMATION           */
+/*-----------------------*/
+
+int sugWords(const sugContext *ctx);            // words in each password
+uint32_t sugDictSize(const sugContext *ctx);    // words in the dictionary
+double sugEntropy(const sugContext *ctx);       // bits of entropy in each password
+size_t sugMaxLength(const sugContext *ctx);     // longest a password can be - no NUL
+const char *sugEngineName(const sugContext *ctx);
+const char *sugKernelName(const sugContext *ctx);
+const char *sugModeName(const sugContext *ctx);
+
+/*-----------------------*/
+/* GENERATION            */
+/*-----------------------*/
+
+/* make one password: the plain form into 'plain' (sugMaxLength() + 1 bytes)
+   and, if not NULL, the form with spaces into 'spaced' (2 * sugMaxLength()
+   + 1 bytes is always enough). Both are NUL terminated. Returns the length
+   of the plain form - or 0 (an empty password) if generation failed */
+size_t sugGenerate(sugContext *ctx, char *plain, char *spaced);
+/* make up to 'count' passwords into 'buf' of 'bufLen' bytes - each followed
+   by 'term' (eg '\n' or '\0'). Stops early when 'buf' is full. Sets '*used'
+   to the bytes used, and returns the number of passwords made - or -1 if
+   generation failed (see sugLoadBlocklist()). Makes no allocations */
+long long sugGenerateBatch(sugContext *ctx, long long count, char term, char *buf, size_t bufLen, size_t *used);
+
+/*-----------------------*/
+/* RECORD FORMATS        */
+/*-----------------------*/
+
+/* format of the records made by sugFormatBatch(), by name: "raw" (the
+   password and '\n' - the default), "nul" (the password and '\0'), "csv" or
+   "jsonl" (JSON lines). csv and jsonl records hold the password, the form
+   with spaces, its entropy and its number (see sugTell()) */
+int sugSetFormat(sugContext *ctx, const char *name);
+/* line to output once before the records - "" if the format has none */
+const char *sugFormatHeader(const sugContext *ctx);
+/* bytes of 'buf' sugFormatBatch() needs for each record - more than the
+   longest record, as the password is first made at the end of 'buf' */
+size_t sugRecordLength(const sugContext *ctx);
+/* as sugGenerateBatch() - but each password as a record of the format set
+   by sugSetFormat(). Records always end with '\n', except "nul" with '\0' */
+long long sugFormatBatch(sugContext *ctx, long long count, char *buf, size_t bufLen, size_t *used);
+/* the password of the record 'rec' of 'len' bytes (no '\n' or '\0' on the
+   end) - as written in the record, so with any quoting or escapes. Sets
+   '*pwLen' to its length */
+const char *sugRecordPassword(const sugContext *ctx, const char *rec, size_t len, size_t *pwLen);
+
+/*-----------------------*/
+/* WORD LISTS            */
+/*-----------------------*/
+
+/* convert the word list 'in' to the binary word list 'out' - errors are
+   reported by sugError(ctx) */
+int sugCompileWordList(sugContext *ctx, const char *in, const char *out);
+/* remove every word in the word list 'path' from the context's dictionary -
+   compared ignoring case */
+int sugExcludeWords(sugContext *ctx, const char *path);
+/* number of the dictionary word 'w' of 'len' characters (ignoring case) -
+   or -1 if it is not in the dictionary. Uses a minimal perfect hash of
+   the dictionary, made the first time it is needed */
+long sugWordIndex(sugContext *ctx, const char *w, size_t len);
+
+/*-----------------------*/
+/* ENCODING              */
+/*-----------------------*/
+
+/* most bytes in a number given to sugEncode() or from sugDecode() */
+#define SUG_CODE_MAX 64
+
+/* the password for the number in the 'len' big endian bytes at 'num': its
+   digits in base sugDictSize() as words, most significant first, joined
+   by the policy separator (or a space if there is none, and the words
+   vary in length). 'nWords' words are used - or if 0, the fewest
+   that can hold any number of 'len' bytes. So every number below
+   sugDictSize() ^ nWords has one password and each password one number.
+   Put into 'out' of 'outLen' bytes, NUL terminated. Returns its length,
+   or -1 if the number needs more words or 'out' is too small */
+long sugEncode(sugContext *ctx, const unsigned char *num, size_t len, int nWords, char *out, size_t outLen);
+/* the number the password 'pw' encodes (see sugEncode()) into the 'numLen'
+   big endian bytes at 'num'. Words are found ignoring case, and split at
+   spaces or the policy separator - or if there are none and all words
+   are the same length, every 'wordLen' characters. Returns the
+   number of words, or -1 if one is not in the dictionary or the number
+   does not fit */
+int sugDecode(sugContext *ctx, const char *pw, unsigned char *num, size_t numLen);
+
+/*-----------------------*/
+/* BLOCKLISTS            */
+/*-----------------------*/
+
+/* never make a password that is in the blocklist file 'path' (see
+   sugCompileBlocklist()). The file is mapped, not read - so any size
+   loads at once. Once set, generation can fail (-1 from
+   sugGenerateBatch()) if almost every password is in the blocklist */
+int sugLoadBlocklist(sugContext *ctx, const char *path);
+/* convert 'in' - SHA-1 hashes in hex, one per line, as 'HASH' or
+   'HASH:COUNT' (eg a breached password corpus), or else plain passwords
+   one per line - to the blocklist file 'out'. Returns the number of
+   hashes written, or -1 */
+long long sugCompileBlocklist(sugContext *ctx, const char *in, const char *out);
+
+/*-----------------------*/
+/* HASHING               */
+/*-----------------------*/
+
+/* longest hash sugHashBatch() can add to a password */
+#define SUG_HASH_MAX 128
+
+/* add a salted hash of each password, for storing: "sha512-crypt" (the '$6$'
+   hash of crypt(3) and /etc/shadow) or "pbkdf2-sha256" (passlib's
+   '$pbkdf2-sha256$' form) with 'rounds' rounds - or if 0 the usual 5000 or
+   29000. "none" or NULL turns hashing off. Salts are always random - even
+   with sugSetSeed() */
+int sugSetHash(sugContext *ctx, const char *name, unsigned long rounds);
+/* longest hash sugHashBatch() adds to a password - not counting the tab */
+size_t sugHashLength(const sugContext *ctx);
+/* copy the passwords in 'in' ('len' bytes, one per line) to 'out' of
+   'outLen' bytes as 'password<TAB>hash' lines, and set '*used' to the
+   bytes written. Several passwords are hashed at once with SIMD. 'out'
+   needs 'len' + 1 bytes, plus sugHashLength() + 1 for each line. Returns
+   the number of lines - or -1 if 'out' is too small or no hash is set */
+long long sugHashBatch(sugContext *ctx, const char *in, size_t len, char *out, size_t outLen, size_t *used);
+
+/*-----------------------*/
+/* STATISTICS            */
+/*-----------------------*/
+
+/* turn the timers on (1) or off (0) - counters are always kept */
+void sugStatsEnable(int on);
+/* add the calling thread's counters to the totals */
+void sugStatsMerge(void);
+/* copy the totals of all merged counters into '*out' */
+void sugStatsGet(runStats *out);
+/* bytes allocated by the library (and sugMalloc()) so far */
+unsigned long long sugAllocatedBytes(void);
+/* malloc() that counts the bytes in sugAllocatedBytes() */
+void *sugMalloc(size_t size);
+
+#if defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
+
+/*-------------------------------------------------------------------*/
+/* INTERNALS - for the sugpass program and benchmarks only. Programs  */
+/* using the library should not define SUGPASS_INTERNAL.              */
+/*-------------------------------------------------------------------*/
+
+#ifdef SUGPASS_INTERNAL
+
+#include <stdatomic.h> // used for shared dictionary reference counts
+#include <time.h>     // used for clock_gettime()
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD 1
+#include <x86intrin.h> // used for __rdtsc() cycle counts
+#endif
+
+/* set to 0 (eg -DSUGPASS_STATS=0) to compile out all '--stats' counters and timers */
+#ifndef SUGPASS_STATS
+#define SUGPASS_STATS 1
+#endif
+
+/* number of 32 bit values held in a random engine's output buffer -
+   refilled in one batch when used up. 1024 == 64 ChaCha20 blocks */
+#define RNG_BUF_WORDS 1024
+
+/*
+	randEngine holds the state of a random number engine. Random values
+	are produced in batches into 'buf' by the engine's refill() function
+	and then handed out one at a time by rngNext32()
+*/
+typedef struct randEngine randEngine;
+struct randEngine {
+	const char *name;               // engine name as given to '-r'
+	void (*refill)(randEngine *);   // fills 'buf' with new random values
+	uint32_t key[8];                // ChaCha20 key
+	uint64_t counter;               // ChaCha20 block counter
+	uint64_t nonce;                 // ChaCha20 nonce - the password number if seeded
+	int seeded;                     // 1 == set by sugSetSeed() - see rngStartPassword()
+	int needSeed;                   // 1 == still to be seeded from the OS - see rngSeed()
+	uint64_t next;                  // number of the next password - see sugTell()
+	size_t pos;                     // next unused value in 'buf'
+	uint32_t buf[RNG_BUF_WORDS];    // batch of random values
+};
+
+/* length of every word in the built in words[] array */
+#define WORD_LEN 3
+/* bytes used by each word in the built in words[] table - the word plus a NUL */
+#define WORD_STRIDE 4
+/* longest word accepted from a word list file */
+#define MAX_WORD_LEN 64
+
+/*
+	wordDict is the dictionary passwords are made from. The words are
+	packed one after another in 'data' with no separators, and the
+	'offset' index gives where each starts: word 'i' is the characters
+	data[offset[i]] up to data[offset[i+1]]. So there are count + 1
+	offsets. When every word is the same length 'wordLen' is set to it
+	and the words are instead at a fixed 'stride' - word 'i' starts at
+	data[i * stride] - and 'offset' is NULL. Three letter words use a
+	stride of WORD_STRIDE (4) so each can be loaded as one 32 bit value
+	- see assembleStride4(). A dictionary loaded from a binary word list
+	points straight into the read only file mapping.
+
+	A dictionary may be shared by several contexts: 'refs' counts them,
+	and when 'owned' is set the memory is freed (or unmapped) once the
+	last of them is freed. The built in dictionary is never freed - it
+	is made at compile time, hash and all (see sugwords.h).
+
+	'hash' is a minimal perfect hash of the words to find a word's
+	number - see wordHash. It is only made when first needed.
+*/
+typedef struct wordHash wordHash;
+typedef struct {
+	char *data;          // packed word characters
+	uint32_t *offset;    // count + 1 offsets into 'data' - NULL if wordLen set
+	uint32_t count;      // number of words
+	uint32_t wordLen;    // length of all words - or 0 if lengths vary
+	uint32_t stride;     // bytes from one word to the next if wordLen set
+	uint32_t maxLen;     // length of the longest word
+	double bits;         // log2(count) - bits of entropy each word adds
+	_Atomic int refs;    // contexts using the dictionary
+	int owned;           // 1 == free 'data', 'offset' and 'map' when unused
+	const char *map;     // file mapping 'data' points into - or NULL
+	size_t mapSize;      // bytes in 'map'
+	wordHash *_Atomic hash;   // word to number hash - NULL until needed
+} wordDict;
+
+/*
+	wordHash is a minimal perfect hash of a dictionary's words (in lower
+	case) - made by "hash and displace". Each word's 64 bit hash picks a
+	bucket of about WHASH_BUCKET_SIZE words, and each bucket has a
+	'pilot' value, found when the hash is made, that moves all of its
+	words to slots no other word uses. So there are exactly 'count'
+	slots, one per word, and finding a word takes one hash, one pilot
+	and one slot lookup - then a compare, as a string that is not a
+	word still lands on some slot. 'slot' gives the word number in each.
+*/
+#define WHASH_BUCKET_SIZE 4
+
+struct wordHash {
+	uint64_t seed;       // hash seed - the first that let every bucket be placed
+	uint32_t buckets;    // number of buckets
+	uint32_t *pilot;     // pilot value of each bucket
+	uint32_t *slot;      // word number in each slot - 'count' of them
+};
+
+/*
+	swlHeader is the start of a binary word list file as written by
+	'--compile-wordlist'. The file is laid out so it can be used where
+	it is mapped into memory with no parsing or copying:
+
+	    header    - this struct (SWL_HEADER_SIZE bytes)
+	    index     - count + 1 uint32_t offsets (only if wordLen == 0)
+	    data      - the packed word characters - at 'stride' bytes
+	                apart if wordLen is set
+
+	'checksum' covers everything after the header. All values are in
+	the byte order of the computer that wrote the file - 'byteOrder'
+	lets a computer with a different byte order reject it.
+*/
+#define SWL_MAGIC "SWL\x1a"
+#define SWL_VERSION 1
+#define SWL_BYTE_ORDER 0x01020304
+#define SWL_HEADER_SIZE 72
+
+typedef struct {
+	char magic[4];           // SWL_MAGIC
+	uint32_t version;        // SWL_VERSION
+	uint32_t byteOrder;      // SWL_BYTE_ORDER as written
+	uint32_t count;          // number of words
+	uint32_t wordLen;        // length of all words - or 0 if lengths vary
+	uint32_t maxLen;         // length of the longest word
+	uint32_t stride;         // bytes from one word to the next - 0 if lengths vary
+	uint32_t reserved;       // unused - always 0
+	uint64_t indexOffset;    // file offset of the index - 0 if none
+	uint64_t dataOffset;     // file offset of the word characters
+	uint64_t dataSize;       // bytes of word characters
+	double entropyPerWord;   // log2(count) - bits of entropy each word adds
+	uint64_t checksum;       // checksum of the file after the header
+} swlHeader;
+_Static_assert(sizeof(swlHeader) == SWL_HEADER_SIZE, "swlHeader must be SWL_HEADER_SIZE bytes");
+
+/*
+	blockList is a blocklist of passwords loaded by sugLoadBlocklist()
+	from a file written by '--compile-blocklist'. The file is laid out
+	so it is used where it is mapped into memory:
+
+	    header    - sblHeader (SBL_HEADER_SIZE bytes)
+	    bloom     - Bloom filter of bloomBlocks 64 byte blocks
+	    hashes    - 'count' 20 byte SHA-1 hashes, sorted, no repeats
+
+	Each password checked is hashed with SHA-1. The Bloom filter is
+	tried first: the hash picks one 64 byte block (so one cache line is
+	read) and BLOOM_PROBES bits in it, and if any is clear the password
+	is not in the list. Almost every generated password is turned away
+	there - the hashes are only searched for the few that get through,
+	with an interpolation search as SHA-1 hashes are evenly spread, so
+	only a handful of pages of even a very large file are touched.
+
+	Like a dictionary, a blocklist is shared by contexts made with
+	sugClone(): 'refs' counts them and the file is unmapped by the last.
+*/
+#define SBL_MAGIC "SBL\x1a"
+#define SBL_VERSION 1
+#define SBL_HEADER_SIZE 64
+#define SBL_HASH_LEN 20
+/* bits set in a Bloom filter block for each hash - and bits of filter
+   per hash, before rounding the blocks up to a power of 2 */
+#define BLOOM_PROBES 7
+#define BLOOM_BITS_PER_HASH 12
+
+typedef struct {
+	char magic[4];           // SBL_MAGIC
+	uint32_t version;        // SBL_VERSION
+	uint32_t byteOrder;      // SWL_BYTE_ORDER as written
+	uint32_t reserved;       // unused - always 0
+	uint64_t count;          // number of hashes
+	uint64_t bloomBlocks;    // 64 byte Bloom filter blocks - a power of 2
+	uint64_t bloomOffset;    // file offset of the Bloom filter
+	uint64_t hashOffset;     // file offset of the sorted hashes
+	uint64_t unused[2];      // unused - always 0
+} sblHeader;
+_Static_assert(sizeof(sblHeader) == SBL_HEADER_SIZE, "sblHeader must be SBL_HEADER_SIZE bytes");
+
+typedef struct {
+	const uint64_t *bloom;        // the Bloom filter - 8 uint64_t per block
+	uint64_t bloomMask;           // bloomBlocks - 1
+	const unsigned char *hash;    // the sorted hashes
+	uint64_t count;               // number of hashes
+	_Atomic int refs;             // contexts using the blocklist
+	const char *map;              // the file mapping
+	size_t mapSize;               // bytes in 'map'
+} blockList;
+
+/*
+	markovModel is the letter Markov chain used by the "markov" mode
+	(see sugSetMode()) - trained from the dictionary by markovBuild().
+	Each state is a pair of letters, and the letter after it is chosen
+	with the weights of how often each follows the pair in the words -
+	so three letters in a row are mostly three letters seen together in
+	a word, which keeps passwords pronounceable. A pair followed by
+	fewer than MARKOV_MIN_CHOICES letters uses the letters that follow
+	its second letter instead. A password starts with a pair chosen by
+	how often words start with it. Letters that are not 'a' to 'z'
+	(after making them lower case) split a word.
+
+	Pairs that still cannot be followed by MARKOV_MIN_CHOICES letters
+	(to pairs that can) are left out, so a password never gets stuck
+	and every letter adds entropy. Each pair's choices are held as a
+	row of an alias table (Walker's alias method), with integer weights
+	so the chances are exact: entry k = rngUniform(count), then k's own
+	letter if rngUniform(total) < cut[k], otherwise its 'alias' entry.
+	So each letter takes one or two random values, however many choices
+	there are. Rows where all choices are equally likely (total 0) need
+	only the first.
+
+	A password's letters give exactly one path through the pairs, so the
+	chance of a password is the product of its choices. minBits[] holds
+	-log2 of the largest of these for each number of syllables (three
+	letters) - its min-entropy - found once when the model is built.
+*/
+#define MARKOV_LETTERS 26
+#define MARKOV_STATES (MARKOV_LETTERS * MARKOV_LETTERS)
+/* row of the table used for the first pair of a password */
+#define MARKOV_START MARKOV_STATES
+#define MARKOV_ENTRIES ((MARKOV_STATES * MARKOV_LETTERS) + MARKOV_STATES)
+/* letters in each syllable - the 'words' of a markov password */
+#define MARKOV_SYLLABLE 3
+/* most syllables in a markov password */
+#define MARKOV_MAX_SYLLABLES 64
+/* fewest letters each pair kept must be able to be followed by */
+#define MARKOV_MIN_CHOICES 2
+
+typedef struct {
+	uint32_t first;      // first entry of the row
+	uint32_t count;      // entries in the row - 0 for a pair left out
+	uint32_t total;      // sum of the entries' weights - 0 if they are all the same
+} markovRow;
+
+typedef struct {
+	markovRow row[MARKOV_STATES + 1];      // each pair - then MARKOV_START
+	uint16_t next[MARKOV_ENTRIES];         // pair each entry leads to - its letter is the second
+	uint16_t alias[MARKOV_ENTRIES];        // entry (in the row) used above the cut
+	uint32_t cut[MARKOV_ENTRIES];          // below this the entry itself is used
+	double minBits[MARKOV_MAX_SYLLABLES + 1]; // min-entropy of each number of syllables
+	uint32_t pairs;                        // pairs kept
+	_Atomic int refs;                      // contexts using the model
+} markovModel;
+
+/*
+	passArena is a caller owned block of memory that generated
+	passwords are written into - see arenaInit() and arenaPassword()
+*/
+typedef struct {
+	char *base;     // start of the caller's memory
+	size_t size;    // total bytes available at 'base'
+	size_t used;    // bytes handed out so far
+} passArena;
+
+/* a password assembly kernel - see assembleStride4Scalar() */
+typedef void (*assembleFn)(const char *, const uint32_t *, int, char *, char *);
+
+/*
+	sugContext is everything needed to generate passwords. Nothing is
+	shared between contexts except the dictionary, blocklist and markov
+	model, which are read only.
+*/
+/* password hashes - see sugSetHash() */
+enum { HASH_NONE = 0, HASH_SHA512_CRYPT, HASH_PBKDF2_SHA256 };
+/* a set of multi buffer hash block functions - see hashKernelTable[] */
+typedef struct hashKernel hashKernel;
+/* record formats - see sugSetFormat() */
+enum { FORMAT_RAW = 0, FORMAT_NUL, FORMAT_CSV, FORMAT_JSONL };
+
+struct sugContext {
+	randEngine eng;          // this context's own random engine
+	wordDict *dict;          // the dictionary - may be shared
+	passPolicy policy;       // rules passwords must meet
+	int nWords;              // words in each password
+	int wordsFloor;          // least words used when meeting a minimum entropy
+	assembleFn assemble;     // kernel for three letter word tables
+	const char *kernel;      // name of 'assemble'
+	blockList *block;        // passwords never to make - NULL if none
+	int failed;              // 1 == no password could be made - see generatePassword()
+	int hash;                // hash added by sugHashBatch() - HASH_NONE if none
+	unsigned long hashRounds; // rounds of the hash
+	const hashKernel *hashKern; // block functions for the hash
+	randEngine saltEng;      // random engine for salts - never seeded by sugSetSeed()
+	int format;              // records made by sugFormatBatch() - FORMAT_RAW by default
+	markovModel *markov;     // letter chain of the "markov" mode - NULL for words
+	char error[SUG_ERR_LEN]; // last error message
+};
+
+/* tables of the random engines and assembly kernels, by name */
+typedef struct {
+	const char *name;
+	void (*refill)(randEngine *);
+} engineEntry;
+typedef struct {
+	const char *name;
+	assembleFn fn;
+} kernelEntry;
+extern const engineEntry engineTable[];
+extern const size_t engineCount;
+extern const kernelEntry kernelTable[];
+extern const size_t kernelCount;
+
+/* the built in words - the number of them, and the number of the first
+   word starting with each letter 'a' to 'z' (then the number of words) */
+extern const char words[][WORD_STRIDE];
+extern const int wordArraySize;
+extern const uint16_t wordLetterStart[27];
+
+/* statistics - see runStats */
+extern int statsOn;
+extern _Thread_local runStats threadStats;
+
+/**-------- FUNCTION: nowNs / cycleCount
+
+   nowNs() is the current time from the monotonic clock in ns.
+   cycleCount() is the CPU cycle counter where there is one - and
+   otherwise the same as nowNs() - used by the '--stats' timers.
+
+*/
+
+static inline uint64_t nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static inline uint64_t cycleCount(void)
+{
+#ifdef HAVE_X86_SIMD
+	return __rdtsc();
+#else
+	return nowNs();
+#endif
+}
+
+/*
+	STAT_ADD() adds to one of this thread's counters.
+	STAT_START() and STAT_STOP() time a stage of generation into one of
+	this thread's timers - only when '--stats' was given.
+	All are removed when SUGPASS_STATS is 0.
+*/
+#if SUGPASS_STATS
+#define STAT_ADD(field, n) (threadStats.field += (n))
+#define STAT_START(t) uint64_t t = statsOn ? cycleCount() : 0
+#define STAT_STOP(t, field) do { if (statsOn) threadStats.field += cycleCount() - (t); } while (0)
+#else
+#define STAT_ADD(field, n) ((void)0)
+#define STAT_START(t) ((void)0)
+#define STAT_STOP(t, field) ((void)0)
+#endif
+
+/**-------- FUNCTION: rngNext32
+
+   return the next 32 bit random value from the engine - refilling
+   its buffer in a batch when all values have been used (a refill may
+   fill just the end of the buffer, setting 'pos' to where it starts)
+
+*/
+
+static inline uint32_t rngNext32(randEngine *eng)
+{
+	if (eng->pos == RNG_BUF_WORDS)
+	{
+		STAT_START(t);
+		eng->refill(eng);
+		STAT_STOP(t, cyclesRng);
+		STAT_ADD(rngRefills, 1);
+		STAT_ADD(rngBytes, (RNG_BUF_WORDS - eng->pos) * sizeof(uint32_t));
+	}
+	return eng->buf[eng->pos++];
+}
+
+/**-------- FUNCTION: rngUniform
+
+   return an unbiased random value in the range 0 to 'range'-1.
+
+   Uses Lemire's multiply-shift method: the 32 bit random value is
+   multiplied by 'range' and the top 32 bits of the product are the
+   result. Products whose low 32 bits fall below (2^32 % range) are
+   rejected and redrawn, which removes the bias that a plain modulo or
+   the old rand() / (RAND_MAX / N + 1) division had. See:
+   https://arxiv.org/abs/1805.10941
+
+*/
+
+static inline uint32_t rngUniform(randEngine *eng, uint32_t range)
+{
+	uint64_t m = (uint64_t)rngNext32(eng) * range;
+	uint32_t low = (uint32_t)m;
+	if (low < range)
+	{
+		// threshold is 2^32 % range - computed only when needed
+		uint32_t threshold = -range % range;
+		while (low < threshold)
+		{
+			STAT_ADD(rejections, 1);
+			m = (uint64_t)rngNext32(eng) * range;
+			low = (uint32_t)m;
+		}
+	}
+	return (uint32_t)(m >> 32);
+}
+
+/**-------- FUNCTION: rngStartPassword
+
+   called as each password is started: count it, and when seeded,
+   switch the engine to the ChaCha20 stream of the next password
+   number, from its first block - so each password's random values
+   depend only on the seed and its number, however many values earlier
+   passwords used
+
+*/
+
+static inline void rngStartPassword(randEngine *eng)
+{
+	if (!eng->seeded)
+	{
+		eng->next++;
+		return;
+	}
+	eng->nonce = eng->next++;
+	eng->counter = 0;
+	eng->pos = RNG_BUF_WORDS;
+}
+
+/**-------- FUNCTION: selectWords
+
+   choose 'n' words from the context's dictionary - each equally
+   likely - and put their numbers in 'idx'. All word selection is done
+   here, so it is what '--quality' tests.
+
+*/
+
+static inline void selectWords(sugContext *ctx, uint32_t *idx, int n)
+{
+	uint32_t count = ctx->dict->count;
+	for (int i = 0; i < n; i++) idx[i] = rngUniform(&ctx->eng, count);
+}
+
+/**-------- FUNCTION: markovStep / markovLetters
+
+   markovStep() picks the entry of the row 'r' of the model 'm' with
+   its alias table, and returns the pair it leads to.
+
+   markovLetters() puts the next 'n' (2 or more) letters of a password
+   at 'out', going on from the pair '*pair' - or from the start of the
+   password if that is MARKOV_START - and sets '*pair' to the last pair.
+
+*/
+
+static inline uint32_t markovStep(const markovModel *m, uint32_t r, randEngine *eng)
+{
+	const markovRow *row = &m->row[r];
+	uint32_t k = rngUniform(eng, row->count);
+	if (row->total && rngUniform(eng, row->total) >= m->cut[row->first + k]) k = m->alias[row->first + k];
+	return m->next[row->first + k];
+}
+
+static inline void markovLetters(const markovModel *m, randEngine *eng, uint32_t *pair, char *out, int n)
+{
+	uint32_t s = *pair;
+	int i = 0;
+	if (s == MARKOV_START)
+	{
+		s = markovStep(m, MARKOV_START, eng);
+		out[i++] = (char)('a' + (s / MARKOV_LETTERS));
+		out[i++] = (char)('a' + (s % MARKOV_LETTERS));
+	}
+	for (; i < n; i++)
+	{
+		s = markovStep(m, s, eng);
+		out[i] = (char)('a' + (s % MARKOV_LETTERS));
+	}
+	*pair = s;
+}
+
+/**-------- FUNCTION: wordHashKey / wordHashBucket / wordHashSlot
+
+   the parts of a wordHash lookup: the 64 bit hash of the word 'w' of
+   'len' characters, in lower case, for the hash 'seed' - the bucket
+   it is in, from the top 32 bits - and the slot it is put in by the
+   bucket's 'pilot', from the rest mixed with the pilot. FNV-1a then
+   the SplitMix64 finaliser so all the bits are well spread.
+
+*/
+
+static inline uint64_t hashMix64(uint64_t x)
+{
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static inline uint64_t wordHashKey(const char *w, size_t len, uint64_t seed)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+	for (size_t i = 0; i < len; i++)
+	{
+		unsigned char c = (unsigned char)w[i];
+		if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+		h = (h ^ c) * 0x100000001b3ULL;
+	}
+	return hashMix64(h ^ len);
+}
+
+static inline uint32_t wordHashBucket(uint64_t key, uint32_t buckets)
+{
+	return (uint32_t)(((key >> 32) * buckets) >> 32);
+}
+
+static inline uint32_t wordHashSlot(uint64_t key, uint32_t pilot, uint32_t count)
+{
+	return (uint32_t)(((hashMix64(key ^ (pilot * 0x9e3779b97f4a7c15ULL)) & 0xffffffffULL) * count) >> 32);
+}
+
+/* arena helpers - see arenaInit() */
+static inline void arenaReset(passArena *a) { a->used = 0; }
+static inline void arenaShrink(passArena *a, size_t unused) { a->used -= unused; }
+static inline char *arenaAlloc(passArena *a, size_t len)
+{
+	if (a->size - a->used < len) return NULL;
+	char *p = a->base + a->used;
+	a->used += len;
+	return p;
+}
+
+/* random engines */
+int getEntropy(void *buf, size_t len);
+void chachaBlock(const uint32_t key[8], uint64_t counter, uint64_t nonce, uint32_t out[16]);
+int rngInit(randEngine *eng, const char *name, char *err);
+int rngSeed(randEngine *eng, char *err);
+
+/* password assembly */
+void assembleStride4Scalar(const char *table, const uint32_t *idx, int n, char *plain, char *spaced);
+int kernelSupported(const char *name);
+size_t buildPassword(sugContext *ctx, char *plain, char *spaced);
+size_t generatePassword(sugContext *ctx, char *plain, char *spaced, size_t *spacedLen);
+
+/* policy */
+size_t maxPassLength(const sugContext *ctx, int nWords);
+int policyTokens(const passPolicy *p, int nWords);
+size_t policyMaxLength(const sugContext *ctx, int nWords);
+double policyEntropy(const sugContext *ctx, int nWords);
+
+/* arenas */
+void arenaInit(passArena *a, char *mem, size_t size);
+int arenaPassword(passArena *a, sugContext *ctx, char **plain, char **spaced);
+
+/* dictionaries */
+const char *mapFile(const char *path, size_t *size, char *err);
+void unmapFile(const char *p, size_t size);
+int dictAlloc(wordDict *d, size_t maxWords, size_t maxChars);
+void dictAdd(wordDict *d, const char *w, uint32_t len);
+void dictRelease(wordDict *d);
+int dictFromFile(wordDict *d, const char *path, char *err);
+
+/* word hashes */
+int wordHashBuild(const wordDict *d, wordHash *h, char *err);
+
+/* markov chains */
+int markovBuild(const wordDict *d, markovModel *m, char *err);
+
+/* blocklists */
+void sha1(const void *msg, size_t len, unsigned char out[SBL_HASH_LEN]);
+int blockListHas(const blockList *b, const char *pw, size_t len);
+
+#endif /* SUGPASS_INTERNAL */
+
+#endif /* LIBSUGPASS_H */
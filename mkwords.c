@@ -0,0 +1,174 @@
+/**
+
+   Program: mkwords
+
+   Created by Simon Rowe <simon@wiremoons.com>
+
+   Updated 17 Oct 2026 - made to build the built in words of libsugpass
+   from 'English-Three-Letter-Word-List.txt', in place of the copy of
+   the list that was kept by hand in the source.
+
+   About
+
+   Run by 'make' as: mkwords WORDLIST HEADER
+
+   Reads the word list WORDLIST (the first word of each line, as '-f'
+   does) and writes the C header HEADER ('sugwords.h') that libsugpass.c
+   includes. The words are made lower case, sorted and any repeats
+   dropped, and every word must then be three letters 'a' to 'z'. The
+   header holds everything worked out from the words, so none of it is
+   done when 'sugpass' runs:
+
+	   the words      - one block of WORD_STRIDE byte entries
+	   count, bits    - the number of words, and log2() of it
+	   wordHash       - the seed and pilots of the minimal perfect hash
+	                    used by '--decode', and the word in each slot
+	   letter index   - the first word starting with each letter
+
+   mkwords is built with libsugpass.c compiled with SUGPASS_MKWORDS set,
+   which leaves out the header it is making.
+
+   The program is licensed under the "MIT License" see
+   http://opensource.org/licenses/MIT for more details.
+
+*/
+
+#define SUGPASS_INTERNAL
+#include "libsugpass.h"	  // for dictFromFile() and wordHashBuild()
+#include <stdio.h>	  // for fprintf() fopen()
+#include <stdlib.h>	  // for qsort() exit()
+#include <string.h>	  // used for memcmp() memmove()
+#include <math.h>	  // used for log2()
+#include <errno.h>	  // used for strerror()
+
+/* values written on each line of the header's tables */
+#define PER_LINE 10
+
+/**-------- FUNCTION: byWord
+
+   qsort() compare of two WORD_STRIDE byte word table entries
+
+*/
+
+static int byWord(const void *a, const void *b)
+{
+	return memcmp(a, b, WORD_STRIDE);
+}
+
+/**-------- FUNCTION: putTable
+
+   write the 'n' values at 'v' to 'fp' as the body of a C array
+
+*/
+
+static void putTable(FILE *fp, const uint32_t *v, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++)
+	{
+		fprintf(fp, "%u%s", v[i], i + 1 == n ? "\n" : ((i + 1) % PER_LINE) ? "," : ",\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 3)
+	{
+		fprintf(stderr,"Usage: mkwords WORDLIST HEADER\n");
+		exit(EXIT_FAILURE);
+	}
+	const char *in = argv[1], *out = argv[2];
+	char err[SUG_ERR_LEN];
+
+	wordDict d;
+	if (dictFromFile(&d, in, err) != 0)
+	{
+		fprintf(stderr,"ERROR: %s\n",err);
+		exit(EXIT_FAILURE);
+	}
+	if (d.wordLen != WORD_LEN || d.stride != WORD_STRIDE)
+	{
+		fprintf(stderr,"ERROR: every word in '%s' must be %d letters\n",in,WORD_LEN);
+		exit(EXIT_FAILURE);
+	}
+
+	// lower case, sorted and no word twice
+	for (uint32_t i = 0; i < d.count; i++)
+	{
+		char *w = d.data + ((size_t)i * WORD_STRIDE);
+		for (int c = 0; c < WORD_LEN; c++)
+		{
+			if (w[c] >= 'A' && w[c] <= 'Z') w[c] += 'a' - 'A';
+			if (w[c] < 'a' || w[c] > 'z')
+			{
+				fprintf(stderr,"ERROR: the word '%.*s' in '%s' is not all letters\n",WORD_LEN,w,in);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	qsort(d.data, d.count, WORD_STRIDE, byWord);
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < d.count; i++)
+	{
+		const char *w = d.data + ((size_t)i * WORD_STRIDE);
+		if (kept > 0 && memcmp(w, d.data + ((size_t)(kept - 1) * WORD_STRIDE), WORD_STRIDE) == 0) continue;
+		memmove(d.data + ((size_t)kept * WORD_STRIDE), w, WORD_STRIDE);
+		kept++;
+	}
+	if (kept != d.count) fprintf(stderr,"NB: %u repeated words in '%s' left out\n",d.count - kept,in);
+	d.count = kept;
+
+	wordHash h;
+	if (wordHashBuild(&d, &h, err) != 0)
+	{
+		fprintf(stderr,"ERROR: %s\n",err);
+		exit(EXIT_FAILURE);
+	}
+
+	// the first word for each letter - and for the letter after 'z', the count
+	uint32_t letter[27];
+	for (uint32_t i = 0, c = 0; c < 27; c++)
+	{
+		while (i < d.count && d.data[(size_t)i * WORD_STRIDE] < (char)('a' + c)) i++;
+		letter[c] = i;
+	}
+
+	FILE *fp = fopen(out, "w");
+	if (fp == NULL)
+	{
+		fprintf(stderr,"ERROR: unable to create '%s': %s\n",out,strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	fprintf(fp, "/*\n\tsugwords.h - the built in words of libsugpass. Made by 'mkwords'\n"
+		"\tfrom '%s' -\n\tdo not edit: change the word list and run 'make'.\n*/\n\n", in);
+	fprintf(fp, "/* number of words - and bits of entropy each adds, log2(SUGWORDS_COUNT) */\n");
+	fprintf(fp, "#define SUGWORDS_COUNT %u\n", d.count);
+	fprintf(fp, "#define SUGWORDS_BITS %.17g\n\n", log2(d.count));
+	fprintf(fp, "/* the words - sorted, in WORD_STRIDE byte entries */\n");
+	fprintf(fp, "_Alignas(64) const char words[SUGWORDS_COUNT][WORD_STRIDE] = {\n");
+	for (uint32_t i = 0; i < d.count; i++)
+	{
+		fprintf(fp, "\"%.*s\"%s", WORD_LEN, d.data + ((size_t)i * WORD_STRIDE),
+			i + 1 == d.count ? "\n" : ((i + 1) % PER_LINE) ? "," : ",\n");
+	}
+	fprintf(fp, "};\n\n");
+	fprintf(fp, "/* number of the first word starting with each letter 'a' to 'z' - then SUGWORDS_COUNT */\n");
+	fprintf(fp, "const uint16_t wordLetterStart[27] = {\n");
+	putTable(fp, letter, 27);
+	fprintf(fp, "};\n\n");
+	fprintf(fp, "/* the wordHash of the words - see wordHashBuild() */\n");
+	fprintf(fp, "#define SUGWORDS_HASH_SEED %lluULL\n", (unsigned long long)h.seed);
+	fprintf(fp, "#define SUGWORDS_HASH_BUCKETS %u\n", h.buckets);
+	fprintf(fp, "static const uint32_t sugWordsPilot[SUGWORDS_HASH_BUCKETS] = {\n");
+	putTable(fp, h.pilot, h.buckets);
+	fprintf(fp, "};\n");
+	fprintf(fp, "static const uint32_t sugWordsSlot[SUGWORDS_COUNT] = {\n");
+	putTable(fp, h.slot, d.count);
+	fprintf(fp, "};\n");
+	if (ferror(fp) | fclose(fp))
+	{
+		fprintf(stderr,"ERROR: unable to write '%s': %s\n",out,strerror(errno));
+		remove(out);
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
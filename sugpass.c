@@ -13,6 +13,96 @@
    Updated 08 Feb 2015 - added display of password with spaces as
    makes them easier to read from the screen. Changed version number.
 
+   Updated 17 Oct 2026 - added '-n' command line option for bulk
+   output of many password suggestions from a single run, written to
+   stdout in large blocks rather than one printf() per line.
+
+   Updated 17 Oct 2026 - replaced rand() seeded by time() with a
+   ChaCha20 random engine seeded from the operating system, and
+   unbiased selection of words. Added '-r' option to choose engine.
+
+   Updated 17 Oct 2026 - passwords now built into caller provided
+   memory (an arena) with the spaced form made in the same pass, in
+   place of the malloc() per password by getRandom() & withSpaces().
+
+   Updated 17 Oct 2026 - added '-j' option so bulk output ('-n') is
+   generated by several threads, each with its own random engine,
+   and written in order by a single writer.
+
+   Updated 17 Oct 2026 - added '-f' option to load a word list file
+   at run time in place of the built in three letter words. Words of
+   any length are supported.
+
+   Updated 17 Oct 2026 - added '--compile-wordlist' to convert a word
+   list file to a binary format that '-f' loads directly from mmap().
+
+   Updated 17 Oct 2026 - built in words now held in a table of fixed
+   four byte entries. Three letter word passwords are assembled with
+   SSSE3 or AVX2 instructions when the CPU has them. Added '--kernel'
+   option to choose how passwords are assembled.
+
+   Updated 17 Oct 2026 - added password policy options: minimum
+   entropy, required digit / uppercase / symbol, maximum length, word
+   separator and capitalisation. Entropy is shown on the curses screen.
+
+   Updated 17 Oct 2026 - added '--bench' to time each way passwords
+   can be generated and output the results as JSON. Run with 'make bench'.
+
+   Updated 17 Oct 2026 - added '--stats' to report counts and timings
+   of each stage of generation at exit, in place of 'All is well'.
+   Compile with -DSUGPASS_STATS=0 to remove the instrumentation.
+
+   Updated 17 Oct 2026 - password generation moved to the library
+   libsugpass (libsugpass.c and libsugpass.h), which keeps all state in
+   a context so it can be used in process and from many threads. This
+   file is now the command line program built on it.
+
+   Updated 17 Oct 2026 - added '--serve' to run as a daemon answering
+   requests for passwords on a Unix socket, from a pool of passwords
+   kept ready by a background thread.
+
+   Updated 17 Oct 2026 - added '--unique' so bulk output never repeats
+   a password, using a hash set of packed passwords - or temporary
+   files for runs too large for '--unique-mem'.
+
+   Updated 17 Oct 2026 - added '--blocklist' to never suggest a password
+   found in a breached password list, checked offline against a mapped
+   file made by '--compile-blocklist' - and '--exclude-words' to remove
+   unwanted words from the dictionary.
+
+   Updated 17 Oct 2026 - added '--seed' to make the same passwords again
+   for the same seed, and '--shard' to make one part of a seeded run -
+   so a large run can be split over several computers with no overlap.
+
+   Updated 17 Oct 2026 - added '--encode' and '--decode' to turn numbers
+   into passwords and back, finding words with a minimal perfect hash.
+   Removed the repeated "wit" and the uppercase "SAY" from words[].
+
+   Updated 17 Oct 2026 - the built in words are now made by 'make' from
+   'English-Three-Letter-Word-List.txt' (see mkwords.c) - sorted, lower
+   case and with no repeats - along with their hash and letter index.
+
+   Updated 17 Oct 2026 - added '--hash' to output each password with its
+   SHA-512-crypt or PBKDF2-SHA256 hash, made several at once with SIMD
+   and spread over all the CPUs by the '-j' threads.
+
+   Updated 17 Oct 2026 - added '--format' for csv, JSON lines or NUL
+   separated output. Bulk output is now written with writev() - or
+   vmsplice() when stdout is a pipe, so it is not copied.
+
+   Updated 17 Oct 2026 - added 'make headless' for a statically linked
+   build with no curses (-DSUGPASS_HEADLESS) that shows the suggestions
+   as plain text. Random engines are now only seeded when first used,
+   and '--bench-startup' times how long a run of '-q' takes.
+
+   Updated 17 Oct 2026 - added '--mode markov' for pronounceable
+   passwords made a letter at a time from a Markov chain of the word
+   list's letters, with alias tables so each letter takes O(1) time.
+
+   Updated 17 Oct 2026 - added '--quality' and 'make quality' to test
+   the randomness of word selection over billions of words with
+   chi-square, serial correlation and collision tests.
+
    About
    
    Password creation tool using a pool of three letter English words
@@ -22,22 +112,47 @@
    (ABSP), from the web page is here:
    http://www.absp.org.uk/words/3lw.shtml
 
-   Compile with: `gcc -Wall --std=gnu11 -o sugpass sugpass.c -lncurses` or use
-   the provided 'Makefile'.
+   Compile with: `gcc -Wall --std=gnu11 -o sugpass sugpass.c libsugpass.c
+   -lncurses -lpthread -lm` or use the provided 'Makefile'.
 
    The program is licensed under the "MIT License" see
    http://opensource.org/licenses/MIT for more details.
 
 */
 
+#if defined(__linux__)
+#define _GNU_SOURCE   // required before any include to declare accept4()
+#endif
+#define SUGPASS_INTERNAL
+#include "libsugpass.h"	  // the password generation library
 #include <stdio.h>	  // for printf() fprintf(stderr)
-#include <time.h>	  // for use of time() as seed
-#include <stdlib.h>	  // for use of rand() atexit() malloc()
-#include <string.h>	  // used for strncat()
+#include <stdlib.h>	  // for use of atexit() malloc()
+#include <stdint.h>	  // used for fixed size uint32_t uint64_t
+#include <string.h>	  // used for memcpy() strlen()
 #include <unistd.h>	  // used for getopt()
+#include <getopt.h>	  // used for getopt_long()
+#include <math.h>	  // used for ceil() log2()
 #include <ctype.h>	  // used for isdigit()
 #include <errno.h>	  // used for strerror()	
+#ifndef SUGPASS_HEADLESS
 #include <curses.h>   // required for ncusres/curses/pdcurses
+#endif
+#include <pthread.h>  // used for pthread_create() in threaded bulk output
+#include <sched.h>    // used for sched_yield()
+#include <stdatomic.h> // used for lock free hand over between threads
+#include <fcntl.h>    // used for open() of /dev/null in benchmarks
+#include <signal.h>   // used for signal() to stop '--serve'
+#include <sys/stat.h> // used for lstat() of the '--serve' socket path
+#include <sys/uio.h>  // used for writev() of bulk output
+#if defined(__linux__)
+#include <sys/ioctl.h>  // used for FIONREAD - bytes still in a pipe
+#include <poll.h>       // used for poll() to see a pipe's reader has gone
+#include <sys/epoll.h>  // used for epoll_wait() event loop of '--serve'
+#include <sys/socket.h> // used for the '--serve' Unix socket
+#include <sys/un.h>     // used for struct sockaddr_un
+#include <sys/wait.h>   // used for waitpid() of '--bench-startup' runs
+#include <spawn.h>      // used for posix_spawn() of '--bench-startup' runs
+#endif
 
 /*-----------------------*/
 /* SET GLOBAL VARIABLES  */
@@ -51,169 +166,337 @@ int debug = 0;
 int export = 0;
 /* control if -q quick output is provided (0 == quick off; 1 == quick on;)*/
 int quick = 0;
-/* number of words in the word array */
-int wordArraySize = 0;
 /* define how many random words we want to include for each password */
 int wordsRequired = 4;
+/* set if the number of words was given with '-w' (0 == default used) */
+int wordsGiven = 0;
 /* define how many password suggestions we want to provide */
 int numPassSuggestions = 3;
-/* 
-	char *words is a pointer to array of strings. 
-	Each string in the array contains a three letter word 
-*/
-char *words[] = { 
-"aah","aal","aas","aba","abb","abo","abs","aby","ace","ach",
-"act","add","ado","ads","adz","aff","aft","aga","age","ago",
-"ags","aha","ahi","ahs","aia","aid","ail","aim","ain","air",
-"ais","ait","aka","ake","ala","alb","ale","alf","all","alp",
-"als","alt","alu","ama","ame","ami","amp","amu","ana","and",
-"ane","ani","ann","ans","ant","any","ape","apo","app","apt",
-"arb","arc","ard","are","arf","ark","arm","ars","art","ary",
-"ash","ask","asp","ass","ate","ats","att","aua","aue","auf",
-"auk","ava","ave","avo","awa","awe","awk","awl","awn","axe",
-"aye","ays","ayu","azo","baa","bac","bad","bag","bah","bal",
-"bam","ban","bap","bar","bas","bat","bay","bed","bee","beg",
-"bel","ben","bes","bet","bey","bez","bib","bid","big","bin",
-"bio","bis","bit","biz","boa","bob","bod","bog","boh","boi",
-"bok","bon","boo","bop","bor","bos","bot","bow","box","boy",
-"bra","bro","brr","bru","bub","bud","bug","bum","bun","bur",
-"bus","but","buy","bye","bys","caa","cab","cad","cag","cam",
-"can","cap","car","cat","caw","cay","caz","cee","cel","cep",
-"cha","che","chi","cid","cig","cis","cit","cly","cob","cod",
-"cog","col","con","coo","cop","cor","cos","cot","cow","cox",
-"coy","coz","cru","cry","cub","cud","cue","cum","cup","cur",
-"cut","cuz","cwm","dab","dad","dae","dag","dah","dak","dal",
-"dam","dan","dap","das","daw","day","deb","dee","def","deg",
-"dei","del","den","dev","dew","dex","dey","dib","did","die",
-"dif","dig","dim","din","dip","dis","dit","div","dob","doc",
-"dod","doe","dof","dog","doh","dol","dom","don","doo","dop",
-"dor","dos","dot","dow","doy","dry","dso","dub","dud","due",
-"dug","duh","dui","dun","duo","dup","dux","dye","dzo","ean",
-"ear","eas","eat","eau","ebb","ech","eco","ecu","edh","eds",
-"eek","eel","een","eff","efs","eft","egg","ego","ehs","eik",
-"eke","eld","elf","elk","ell","elm","els","elt","eme","emo",
-"ems","emu","end","ene","eng","ens","eon","era","ere","erf",
-"erg","erk","erm","ern","err","ers","ess","est","eta","eth",
-"euk","eve","evo","ewe","ewk","ewt","exo","eye","faa","fab",
-"fad","fae","fag","fah","fan","fap","far","fas","fat","faw",
-"fax","fay","fed","fee","feg","feh","fem","fen","fer","fes",
-"fet","feu","few","fey","fez","fib","fid","fie","fig","fil",
-"fin","fir","fit","fix","fiz","flu","fly","fob","foe","fog",
-"foh","fon","fop","for","fou","fox","foy","fra","fro","fry",
-"fub","fud","fug","fum","fun","fur","gab","gad","gae","gag",
-"gak","gal","gam","gan","gap","gar","gas","gat","gau","gaw",
-"gay","ged","gee","gel","gem","gen","geo","ger","get","gey",
-"ghi","gib","gid","gie","gif","gig","gin","gio","gip","gis",
-"git","gju","gnu","goa","gob","god","goe","gon","goo","gor",
-"gos","got","gov","gox","goy","gub","gue","gul","gum","gun",
-"gup","gur","gus","gut","guv","guy","gym","gyp","had","hae",
-"hag","hah","haj","ham","han","hao","hap","has","hat","haw",
-"hay","heh","hem","hen","hep","her","hes","het","hew","hex",
-"hey","hic","hid","hie","him","hin","hip","his","hit","hmm",
-"hoa","hob","hoc","hod","hoe","hog","hoh","hoi","hom","hon",
-"hoo","hop","hos","hot","how","hox","hoy","hub","hue","hug",
-"huh","hui","hum","hun","hup","hut","hye","hyp","ice","ich",
-"ick","icy","ide","ids","iff","ifs","igg","ilk","ill","imp",
-"ing","ink","inn","ins","ion","ios","ire","irk","ish","ism",
-"iso","ita","its","ivy","iwi","jab","jag","jai","jak","jam",
-"jap","jar","jaw","jay","jee","jet","jeu","jew","jib","jig",
-"jin","jiz","job","joe","jog","jol","jor","jot","jow","joy",
-"jud","jug","jun","jus","jut","kab","kae","kaf","kai","kak",
-"kam","kas","kat","kaw","kay","kea","keb","ked","kef","keg",
-"ken","kep","ket","kex","key","khi","kid","kif","kin","kip",
-"kir","kis","kit","koa","kob","koi","kon","kop","kor","kos",
-"kow","kue","kye","kyu","lab","lac","lad","lag","lah","lam",
-"lap","lar","las","lat","lav","law","lax","lay","lea","led",
-"lee","leg","lei","lek","lep","les","let","leu","lev","lew",
-"lex","ley","lez","lib","lid","lie","lig","lin","lip","lis",
-"lit","lob","lod","log","loo","lop","lor","los","lot","lou",
-"low","lox","loy","lud","lug","lum","lur","luv","lux","luz",
-"lye","lym","maa","mac","mad","mae","mag","mak","mal","mam",
-"man","map","mar","mas","mat","maw","max","may","med","mee",
-"meg","meh","mel","mem","men","mes","met","meu","mew","mho",
-"mib","mic","mid","mig","mil","mim","mir","mis","mix","miz",
-"mna","moa","mob","moc","mod","moe","mog","moi","mol","mom",
-"mon","wit","moo","mop","mor","mos","mot","mou","mow","moy",
-"moz","mud","mug","mum","mun","mus","mut","mux","myc","nab",
-"nae","nag","nah","nam","nan","nap","nas","nat","naw","nay",
-"neb","ned","nee","nef","neg","nek","nep","net","new","nib",
-"nid","nie","nil","nim","nip","nis","nit","nix","nob","nod",
-"nog","noh","nom","non","noo","nor","nos","not","now","nox",
-"noy","nth","nub","nun","nur","nus","nut","nye","nys","oaf",
-"oak","oar","oat","oba","obe","obi","obo","obs","oca","och",
-"oda","odd","ode","ods","oes","off","oft","ohm","oho","ohs",
-"oik","oil","ois","oka","oke","old","ole","olm","oms","one",
-"ono","ons","ony","oof","ooh","oom","oon","oop","oor","oos",
-"oot","ope","ops","opt","ora","orb","orc","ord","ore","orf",
-"ors","ort","ose","oud","ouk","oup","our","ous","out","ova",
-"owe","owl","own","owt","oxo","oxy","oye","oys","pac","pad",
-"pah","pal","pam","pan","pap","par","pas","pat","pav","paw",
-"pax","pay","pea","pec","ped","pee","peg","peh","pel","pen",
-"pep","per","pes","pet","pew","phi","pho","pht","pia","pic",
-"pie","pig","pin","pip","pir","pis","pit","piu","pix","plu",
-"ply","poa","pod","poh","poi","pol","pom","poo","pop","pos",
-"pot","pow","pox","poz","pre","pro","pry","psi","pst","pub",
-"pud","pug","puh","pul","pun","pup","pur","pus","put","puy",
-"pya","pye","pyx","qat","qis","qua","qin","rad","rag","rah",
-"rai","raj","ram","ran","rap","ras","rat","rav","raw","rax",
-"ray","reb","rec","red","ree","ref","reg","reh","rei","rem",
-"ren","reo","rep","res","ret","rev","rew","rex","rez","rho",
-"rhy","ria","rib","rid","rif","rig","rim","rin","rip","rit",
-"riz","rob","roc","rod","roe","rok","rom","roo","rot","row",
-"rub","ruc","rud","rue","rug","rum","run","rut","rya","rye",
-"sab","sac","sad","sae","sag","sai","sal","sam","san","sap",
-"sar","sat","sau","sav","saw","sax","say","SAY","saz","sea",
-"sec","sed","see","seg","sei","sel","sen","ser","set","sew",
-"sex","sey","sez","sha","she","shh","shy","sib","sic","sif",
-"sik","sim","sin","sip","sir","sis","sit","six","ska","ski",
-"sky","sly","sma","sny","sob","soc","sod","sog","soh","sol",
-"som","son","sop","sos","sot","sou","sov","sow","sox","soy",
-"soz","spa","spy","sri","sty","sub","sud","sue","sug","sui",
-"suk","sum","sun","sup","suq","sur","sus","swy","sye","syn",
-"tab","tad","tae","tag","tai","taj","tak","tam","tan","tao",
-"tap","tar","tas","tat","tau","tav","taw","tax","tay","tea",
-"tec","ted","tee","tef","teg","tel","ten","tes","tet","tew",
-"tex","the","tho","thy","tic","tid","tie","tig","tik","til",
-"tin","tip","tis","tit","tix","toc","tod","toe","tog","tom",
-"ton","too","top","tor","tot","tow","toy","try","tsk","tub",
-"tug","tui","tum","tun","tup","tut","tux","twa","two","twp",
-"tye","tyg","udo","uds","uey","ufo","ugh","ugs","uke","ule",
-"ulu","umm","ump","ums","umu","uni","uns","upo","ups","urb",
-"urd","ure","urn","urp","use","uta","ute","uts","utu","uva",
-"vac","vae","vag","van","var","vas","vat","vau","vav","vaw",
-"vee","veg","vet","vex","via","vid","vie","vig","vim","vin",
-"vis","vly","voe","vol","vor","vow","vox","vug","vum","wab",
-"wad","wae","wag","wai","wan","wap","war","was","wat","waw",
-"wax","way","web","wed","wee","wem","wen","wet","wex","wey",
-"wha","who","why","wig","win","wis","wit","wiz","woe","wof",
-"wog","wok","won","woo","wop","wos","wot","wow","wox","wry",
-"wud","wus","wye","wyn","xis","yad","yae","yag","yah","yak",
-"yam","yap","yar","yaw","yay","yea","yeh","yen","yep","yes",
-"yet","yew","yex","ygo","yid","yin","yip","yob","yod","yok",
-"yom","yon","you","yow","yug","yuk","yum","yup","yus","zag",
-"zap","zas","zax","zea","zed","zee","zek","zel","zep","zex",
-"zho","zig","zin","zip","zit","ziz","zoa","zol","zoo","zos",
-"zuz","zzz" };
+/* number of passwords to output in bulk mode via '-n' (0 == bulk off) */
+long long bulkCount = 0;
+/* size of the reusable output buffer used by bulk mode - flushed with write() */
+#define OUTBUF_SIZE (1024 * 1024)
+/* number of threads to generate bulk output with via '-j' */
+int numThreads = 1;
+/* set if the number of threads was given with '-j' (0 == default used) */
+int threadsGiven = 0;
+/* most threads allowed with '-j' */
+#define MAX_THREADS 256
+/* control if '--stats' report is output at exit (0 == off; 1 == on;) */
+int stats = 0;
+/* time program started - for the '--stats' report */
+uint64_t startNs = 0, startCycles = 0;
+/* control if '--bench' benchmarks are run (0 == off; 1 == on;) */
+int bench = 0;
+/* control if the '--bench-startup' benchmark is run (0 == off; 1 == on;) */
+int benchStartup = 0;
+/* words to draw for the '--quality' tests (0 == off) */
+long long qualityDraws = 0;
+/* size of each chunk of output handed from a worker thread to the writer */
+#define CHUNK_SIZE (256 * 1024)
+/* name of the random engine to use - see engineTable[] for choices (NULL == chacha20) */
+char *engineName = NULL;
+/* word list file to load via '-f' (NULL == use built in words[]) */
+char *wordFile = NULL;
+/* word list files to convert via '--compile-wordlist IN OUT' (NULL == off) */
+char *compileIn = NULL;
+char *compileOut = NULL;
+/* the rules each password must meet - see passPolicy */
+passPolicy policy;
+/* name of the password assembly kernel to use via '--kernel' (NULL == best) */
+char *kernelName = NULL;
+/* the password generator - its dictionary, random engine and policy */
+sugContext *ctx = NULL;
+/* Unix socket path to serve passwords on via '--serve' (NULL == off) */
+char *servePath = NULL;
+/* control if '--unique' bulk output is provided (0 == off; 1 == on;) */
+int unique = 0;
+/* most memory for the '--unique' set before using temporary files - set by '--unique-mem' */
+size_t uniqueMem = (size_t)256 * 1024 * 1024;
+/* passwords output so far by '--unique' - see uniqueSet (NULL == off) */
+struct uniqueSet *seen = NULL;
+/* blocklist file of passwords never to suggest via '--blocklist' (NULL == off) */
+char *blockFile = NULL;
+/* files to convert via '--compile-blocklist IN OUT' (NULL == off) */
+char *compileBlockIn = NULL;
+char *compileBlockOut = NULL;
+/* word list file of words to remove from the dictionary via '--exclude-words' (NULL == off) */
+char *excludeFile = NULL;
+/* seed to make a reproducible run of passwords via '--seed' (NULL == random) */
+char *seed = NULL;
+/* part of a seeded '-n' run to output via '--shard I/N' - part 'shardIndex'
+   (1 to shardCount) of 'shardCount' equal parts (0 == whole run) */
+long long shardIndex = 0, shardCount = 0;
+/* with a seed: number of the first password past the run, used in place
+   of repeats dropped by '--unique' - see useSpare() */
+uint64_t spareStart = 0;
+int spareInUse = 0;
+/* control if '--encode' or '--decode' is run (0 == off; 1 == on;) - on the
+   values left on the command line, or if none, lines read from stdin */
+int encode = 0, decode = 0;
+char **codeArgs = NULL;
+int codeArgCount = 0;
+/* most parts a run can be split into by '--shard' */
+#define SHARD_MAX 1000000
+/* hash to output with each password via '--hash' (NULL == off) - and its
+   rounds from '--hash-rounds' (0 == the usual for the hash) */
+char *hashName = NULL;
+unsigned long hashRounds = 0;
+/* set once a hash is in use - bulk output is then 'password<TAB>hash' lines */
+int hashing = 0;
+/* format of bulk output records via '--format' (NULL == raw) - and the
+   character each record ends with */
+char *formatName = NULL;
+char recordEnd = '\n';
+/* how passwords are made via '--mode' (NULL == words) */
+char *modeName = NULL;
+/* control if bulk output is written with vmsplice() - set when stdout is a
+   pipe (0 == writev()) - and if any has been */
+int spliceOut = 0, spliced = 0;
+/* bytes output so far - to know when memory given to vmsplice() is free */
+uint64_t outOffset = 0;
+/* most chunks of threaded output written by one system call */
+#define WRITE_GATHER 64
+
+
+
+/**-------- FUNCTION: parseRequire
+
+   set the rules in policy 'pol' from a '--require' list - comma
+   separated, of: digit, upper, symbol. Returns -1 if anything else is
+   given. Also used for the 'require=' of '--serve' requests.
+
+*/
 
+int parseRequire(const char *list, passPolicy *pol)
+{
+	const char *p = list;
+	while (*p)
+	{
+		size_t len = strcspn(p, ",");
+		if (len == 5 && strncmp(p, "digit", 5) == 0) pol->requireDigit = 1;
+		else if (len == 5 && strncmp(p, "upper", 5) == 0) pol->requireUpper = 1;
+		else if (len == 6 && strncmp(p, "symbol", 6) == 0) pol->requireSymbol = 1;
+		else return -1;
+		p += len;
+		if (*p == ',') p++;
+	}
+	return 0;
+}
 
 
 /**-------- FUNCTION: getCLIArgs
 
 Function called when program starts. Used to parse command line
-options provided by the user using the POSIX compliant getopts()
+options provided by the user using getopt_long() - so the POSIX
+single letter options plus the longer '--' options below
 
 */
 
+/* values returned by getopt_long() for options with no single letter */
+enum {
+	OPT_COMPILE_WORDLIST = 256,
+	OPT_KERNEL,
+	OPT_MIN_ENTROPY,
+	OPT_REQUIRE,
+	OPT_MAX_LEN,
+	OPT_SEPARATOR,
+	OPT_CAPITALISE,
+	OPT_BENCH,
+	OPT_STATS,
+	OPT_SERVE,
+	OPT_UNIQUE,
+	OPT_UNIQUE_MEM,
+	OPT_BLOCKLIST,
+	OPT_COMPILE_BLOCKLIST,
+	OPT_EXCLUDE_WORDS,
+	OPT_SEED,
+	OPT_SHARD,
+	OPT_ENCODE,
+	OPT_DECODE,
+	OPT_HASH,
+	OPT_HASH_ROUNDS,
+	OPT_FORMAT,
+	OPT_BENCH_STARTUP,
+	OPT_MODE,
+	OPT_QUALITY,
+};
+
+struct option longOpts[] = {
+	{ "compile-wordlist", required_argument, NULL, OPT_COMPILE_WORDLIST },
+	{ "kernel",           required_argument, NULL, OPT_KERNEL },
+	{ "min-entropy",      required_argument, NULL, OPT_MIN_ENTROPY },
+	{ "require",          required_argument, NULL, OPT_REQUIRE },
+	{ "max-len",          required_argument, NULL, OPT_MAX_LEN },
+	{ "separator",        required_argument, NULL, OPT_SEPARATOR },
+	{ "capitalise",       no_argument,       NULL, OPT_CAPITALISE },
+	{ "bench",            no_argument,       NULL, OPT_BENCH },
+	{ "bench-startup",    no_argument,       NULL, OPT_BENCH_STARTUP },
+	{ "mode",             required_argument, NULL, OPT_MODE },
+	{ "quality",          required_argument, NULL, OPT_QUALITY },
+	{ "stats",            no_argument,       NULL, OPT_STATS },
+	{ "serve",            required_argument, NULL, OPT_SERVE },
+	{ "unique",           no_argument,       NULL, OPT_UNIQUE },
+	{ "unique-mem",       required_argument, NULL, OPT_UNIQUE_MEM },
+	{ "blocklist",        required_argument, NULL, OPT_BLOCKLIST },
+	{ "compile-blocklist", required_argument, NULL, OPT_COMPILE_BLOCKLIST },
+	{ "exclude-words",    required_argument, NULL, OPT_EXCLUDE_WORDS },
+	{ "seed",             required_argument, NULL, OPT_SEED },
+	{ "shard",            required_argument, NULL, OPT_SHARD },
+	{ "encode",           no_argument,       NULL, OPT_ENCODE },
+	{ "decode",           no_argument,       NULL, OPT_DECODE },
+	{ "hash",             required_argument, NULL, OPT_HASH },
+	{ "hash-rounds",      required_argument, NULL, OPT_HASH_ROUNDS },
+	{ "format",           required_argument, NULL, OPT_FORMAT },
+	{ NULL, 0, NULL, 0 }
+};
+
 void getCLIArgs(int argc, char **argv)
 {
 	opterr = 0;
 	int c = 0;
 	int index = 0;
 
-  	while ((c = getopt (argc, argv, "vdqw:s:")) != -1) 
+  	while ((c = getopt_long (argc, argv, "vdqw:s:n:r:j:f:", longOpts, NULL)) != -1) 
   	{
 	    switch (c)
             {
+            // convert a word list to binary: --compile-wordlist IN OUT
+            case OPT_COMPILE_WORDLIST:
+                compileIn = optarg;
+                break;
+            // password assembly kernel to use specified
+            case OPT_KERNEL:
+                kernelName = optarg;
+                break;
+            // least entropy each password must have in bits
+            case OPT_MIN_ENTROPY:
+		      	if (isdigit(*optarg)) {
+	                    policy.minEntropy = atof(optarg);
+	        	} else {
+	                    fprintf(stderr,"ERROR: for --min-entropy option please provide a number of bits\n");
+	                    exit(EXIT_FAILURE);
+	        	}
+	        	break;
+            // characters each password must contain - comma separated list
+            case OPT_REQUIRE:
+                if (parseRequire(optarg, &policy) != 0) {
+                    fprintf(stderr,"ERROR: for --require option please choose from: digit,upper,symbol\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            // most characters each password may have
+            case OPT_MAX_LEN:
+		      	if (isdigit(*optarg)) {
+	                    policy.maxLen = atoi(optarg);
+	        	} else {
+	                    fprintf(stderr,"ERROR: for --max-len option please provide a number of characters\n");
+	                    exit(EXIT_FAILURE);
+	        	}
+	        	break;
+            // character to put between words
+            case OPT_SEPARATOR:
+                if (strlen(optarg) != 1 || isalpha((unsigned char)*optarg)) {
+                    fprintf(stderr,"ERROR: for --separator option please provide a single character that is not a letter\n");
+                    exit(EXIT_FAILURE);
+                }
+                policy.separator = *optarg;
+                break;
+            // capitalise the first letter of every word
+            case OPT_CAPITALISE:
+                policy.capitalise = 1;
+                break;
+            // run the benchmarks
+            case OPT_BENCH:
+                bench = 1;
+                break;
+            // time starting the program with '-q'
+            case OPT_BENCH_STARTUP:
+                benchStartup = 1;
+                break;
+            // test the randomness of word selection
+            case OPT_QUALITY:
+		      	if (isdigit(*optarg) && strtoll(optarg,NULL,10) >= 1) {
+	                    qualityDraws = strtoll(optarg,NULL,10);
+	        	} else {
+	                    fprintf(stderr,"ERROR: for --quality option please provide the number of words to draw\n");
+	                    exit(EXIT_FAILURE);
+	        	}
+	        	break;
+            // report stats at exit
+            case OPT_STATS:
+                stats = 1;
+                break;
+            // run as a daemon serving passwords on a Unix socket
+            case OPT_SERVE:
+                servePath = optarg;
+                break;
+            // never output the same password twice
+            case OPT_UNIQUE:
+                unique = 1;
+                break;
+            // most MiB of memory for '--unique' before temporary files are used
+            case OPT_UNIQUE_MEM:
+		      	if (isdigit(*optarg) && atoll(optarg) >= 1) {
+	                    uniqueMem = (size_t)atoll(optarg) * 1024 * 1024;
+	        	} else {
+	                    fprintf(stderr,"ERROR: for --unique-mem option please provide a number of MiB\n");
+	                    exit(EXIT_FAILURE);
+	        	}
+	        	break;
+            // never suggest a password in this blocklist file
+            case OPT_BLOCKLIST:
+                blockFile = optarg;
+                break;
+            // convert a password or hash list to a blocklist: --compile-blocklist IN OUT
+            case OPT_COMPILE_BLOCKLIST:
+                compileBlockIn = optarg;
+                break;
+            // remove the words in this word list file from the dictionary
+            case OPT_EXCLUDE_WORDS:
+                excludeFile = optarg;
+                break;
+            // make the passwords from this seed - so they can be made again
+            case OPT_SEED:
+                seed = optarg;
+                break;
+            // output just this part of the run: --shard I/N
+            case OPT_SHARD:
+                if (sscanf(optarg, "%lld/%lld", &shardIndex, &shardCount) != 2 ||
+                    shardCount < 1 || shardCount > SHARD_MAX || shardIndex < 1 || shardIndex > shardCount) {
+                    fprintf(stderr,"ERROR: for --shard option please provide I/N - part I (1 to N) of N parts, N up to %d\n",SHARD_MAX);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            // turn numbers into passwords
+            case OPT_ENCODE:
+                encode = 1;
+                break;
+            // turn passwords back into numbers
+            case OPT_DECODE:
+                decode = 1;
+                break;
+            // output each password with its hash
+            case OPT_HASH:
+                hashName = optarg;
+                break;
+            // rounds of the '--hash' to use
+            case OPT_HASH_ROUNDS:
+		      	if (isdigit(*optarg) && strtoul(optarg,NULL,10) >= 1) {
+	                    hashRounds = strtoul(optarg,NULL,10);
+	        	} else {
+	                    fprintf(stderr,"ERROR: for --hash-rounds option please provide a number of rounds\n");
+	                    exit(EXIT_FAILURE);
+	        	}
+	        	break;
+            // format of each password output by '-n' or '-q'
+            case OPT_FORMAT:
+                formatName = optarg;
+                break;
+            // make passwords from words or a markov chain of their letters
+            case OPT_MODE:
+                modeName = optarg;
+                break;
             // debugging output was requested
             case 'd':
                 debug = 1;
@@ -234,6 +517,7 @@ void getCLIArgs(int argc, char **argv)
             case 'w':
 		      	if (isdigit(*optarg)) {
 	                    wordsRequired = atoi(optarg);
+	                    wordsGiven = 1;
 		      	} else {
 	                    fprintf(stderr,"ERROR: for -w option please provide numerical digit(s) 1 to 9\n");
 	                    exit(EXIT_FAILURE);
@@ -248,6 +532,33 @@ void getCLIArgs(int argc, char **argv)
 	                    exit(EXIT_FAILURE);
 	        	}
 	        	break;
+            // number of passwords to output in bulk specified
+            case 'n':
+		      	if (isdigit(*optarg)) {
+	                    bulkCount = strtoll(optarg,NULL,10);
+	        	} else {
+	                    fprintf(stderr,"ERROR: for -n option please provide the number of passwords to output\n");
+	                    exit(EXIT_FAILURE);
+	        	}
+	        	break;
+            // number of threads for bulk output specified
+            case 'j':
+		      	if (isdigit(*optarg) && atoi(optarg) >= 1 && atoi(optarg) <= MAX_THREADS) {
+	                    numThreads = atoi(optarg);
+	                    threadsGiven = 1;
+	        	} else {
+	                    fprintf(stderr,"ERROR: for -j option please provide a number of threads 1 to %d\n",MAX_THREADS);
+	                    exit(EXIT_FAILURE);
+	        	}
+	        	break;
+            // word list file to use specified
+            case 'f':
+                wordFile = optarg;
+                break;
+            // random engine to use specified
+            case 'r':
+                engineName = optarg;
+                break;
             // ERROR HANDLING BELOW
 	        //
         	// command line option given but missing required option data
@@ -262,6 +573,28 @@ void getCLIArgs(int argc, char **argv)
 		        break;
             }
         }
+    // the output file for '--compile-wordlist' is the next argument
+    if (compileIn) {
+        if (optind >= argc) {
+            fprintf(stderr,"ERROR: for --compile-wordlist please provide an input and an output file\n");
+            exit(EXIT_FAILURE);
+        }
+        compileOut = argv[optind++];
+    }
+    // the output file for '--compile-blocklist' is the next argument
+    if (compileBlockIn) {
+        if (optind >= argc) {
+            fprintf(stderr,"ERROR: for --compile-blocklist please provide an input and an output file\n");
+            exit(EXIT_FAILURE);
+        }
+        compileBlockOut = argv[optind++];
+    }
+    // the rest of the arguments are the values to encode or decode
+    if (encode || decode) {
+        codeArgs = argv + optind;
+        codeArgCount = argc - optind;
+        optind = argc;
+    }
     // if debugging requested - display extra getopt() info
   	if (debug) {
   		printf ("DEBUG optargs():\n\tdebug = %s\n\tWords per password = %d\n\tNumber of passwords to suggest = %d\n",
@@ -273,20 +606,66 @@ void getCLIArgs(int argc, char **argv)
 }
 
 
+/**-------- FUNCTION: printStats
+
+   output the '--stats' report to stderr: throughput, time spent in
+   each stage of generation, and the counters. Stage times are summed
+   over all threads, so with '-j' they can add up to more than the
+   elapsed time.
+
+*/
+
+void printStats()
+{
+	runStats totals;
+	sugStatsMerge();
+	sugStatsGet(&totals);
+	runStats *t = &totals;
+	uint64_t ns = nowNs() - startNs;
+	double secs = ns / 1e9;
+	// cycles per ns - found from the cycles and time taken over the run
+	double perNs = ns > 0 ? (double)(cycleCount() - startCycles) / ns : 1.0;
+	if (perNs <= 0) perNs = 1.0;
+	uint64_t select = t->cyclesSelect > t->cyclesRng ? t->cyclesSelect - t->cyclesRng : 0;
+
+	fprintf(stderr,"\nsugpass stats:\n");
+	fprintf(stderr,"  elapsed time          %12.6f s\n", secs);
+	fprintf(stderr,"  passwords             %12llu  (%.0f per second)\n",
+		(unsigned long long)t->passwords, secs > 0 ? t->passwords / secs : 0.0);
+	fprintf(stderr,"  words selected        %12llu\n", (unsigned long long)t->words);
+	fprintf(stderr,"  time: random engine   %12.6f s\n", t->cyclesRng / perNs / 1e9);
+	fprintf(stderr,"  time: word selection  %12.6f s\n", select / perNs / 1e9);
+	fprintf(stderr,"  time: formatting      %12.6f s\n", t->cyclesFormat / perNs / 1e9);
+	fprintf(stderr,"  time: hashing         %12.6f s\n", t->cyclesHash / perNs / 1e9);
+	fprintf(stderr,"  time: output          %12.6f s\n", t->cyclesOutput / perNs / 1e9);
+	fprintf(stderr,"  rng bytes consumed    %12llu  (%llu refills)\n",
+		(unsigned long long)t->rngBytes, (unsigned long long)t->rngRefills);
+	fprintf(stderr,"  rejection retries     %12llu\n", (unsigned long long)t->rejections);
+	fprintf(stderr,"  duplicates replaced   %12llu\n", (unsigned long long)t->duplicates);
+	fprintf(stderr,"  blocklisted replaced  %12llu\n", (unsigned long long)t->blocked);
+	fprintf(stderr,"  passwords hashed      %12llu\n", (unsigned long long)t->hashes);
+	fprintf(stderr,"  output syscalls       %12llu  (%llu bytes)\n",
+		(unsigned long long)t->syscalls, (unsigned long long)t->bytesOut);
+#if !SUGPASS_STATS
+	fprintf(stderr,"  NB: compiled with SUGPASS_STATS=0 - counters are not available\n");
+#endif
+}
+
 /**-------- FUNCTION: exitCleanup
 
 function called when program exits
-Used via registration with 'atexit()' in main()
+Registered with 'atexit()' in main() when '--stats' is given - the end
+of run hook, which outputs the '--stats' report
 
 */
 
 void exitCleanup()
 {
-	// output unless quick (-q) command line option was used:
-	if (!quick) printf("\nAll is well\n");
+	if (stats) printStats();
 }
 
 
+#ifndef SUGPASS_HEADLESS
 /**-------- FUNCTION: centerText
 
    function used to print the provided text center on the screen at
@@ -318,234 +697,2590 @@ void endPause()
 	refresh();
 	getch();
 }
+#endif
 
-/**-------- FUNCTION: withSpaces
+/**-------- FUNCTION: dump
 
-   function to add spaces at every third character point in the 
-   string recieved via a pointer to this function.
-   Return a pointer to a new string with the spaces added
+print out the complete list of words held in our words array - one
+line for each letter, using the first letter index made with them
 
 */
-char *withSpaces(char *newpass)
+
+
+void dumpWords()
 {
-	// size_t is %zu for gcc if get warnings for line below on compile
-	if (debug) { printf("DEBUG: password received by func 'withSpaces' is: %s at %d characters length\n",newpass,strlen(newpass) ); }
+	for (int letter = 0; letter < 26; letter++)
+	{
+		if (wordLetterStart[letter] == wordLetterStart[letter+1]) continue;
+		for (int i = wordLetterStart[letter]; i < wordLetterStart[letter+1]; i++)
+		{
+			printf("%s ", *(words+i));
+		}
+		printf("\n");
+	}
+
+
+	// if debug printout first, middle and last words in our array
+	if (debug)
+	{
+		printf("Words array contains %d words -where:\n", wordArraySize);
+		printf("\tFirst word is 'aah'? : %s\n", *(words+0));
+		printf("\tMiddle word is %d is : %s\n", (wordArraySize/2), *(words+((wordArraySize/2)-1)) );		
+		printf("\tLast word is 'zzz'? : %s\n", *(words+wordArraySize-1));
+
+	}
+}
+
+/**-------- FUNCTION: xmalloc
+
+   allocate 'size' bytes with malloc() - exits the program with an
+   error naming the function 'where' if the memory is not available.
+   Counts the bytes allocated, for the benchmarks to report - see
+   sugMalloc().
 
-	// get memory for a new string to contain the password plus the spaces needed.
-	// All words in the passwords are 3 characters in length - so divide password length
-	// by 3 answer will give number of spaces required plus 1 for the '\0' on the end of the new string
-	int length = ( strlen(newpass) + (strlen(newpass)/3) );
-	char *s_newpass = malloc( sizeof(char) * length );
+*/
+
+void *xmalloc(size_t size, const char *where)
+{
+	void *p = sugMalloc(size);
 	// if malloc() failed - exit
-	if (s_newpass == NULL) 
+	if (p == NULL)
 	{
-		fprintf(stderr,"Error allocating memory in withSpaces(): %s\n",strerror(errno));
-		exit(EXIT_FAILURE); 
+		fprintf(stderr,"Error allocating memory in %s(): %s\n",where,strerror(errno));
+		exit(EXIT_FAILURE);
 	}
-	if (debug) { mvprintw(24,1,"Calculated length %d for allocated string length of: %d",
-		length,(strlen(newpass)) + (strlen(newpass)/3)); }
-		
-	// initialise our new malloc variable so works with strncat
-	*s_newpass = '\0';
+	return p;
+}
 
-	// count for string with spaces for pointer location
-	int s = 0;
-	// count for string with no spaces for pointer location
-	int n = 0;
-	// count to insert a space every three characters
-	int addspc = 1;
+/**-------- FUNCTION: xgenerate
 
-	// while we can read the *newpass string passed to this function
-	while ( *(newpass+n) != '\0' )
+   make up to 'count' passwords into 'buf', as records of the '--format'
+   made by sugFormatBatch() - exits the program with the reason if they
+   cannot be made, as when nearly every password is in the blocklist
+
+*/
+
+long long xgenerate(sugContext *c, long long count, char *buf, size_t bufLen, size_t *used)
+{
+	long long made = sugFormatBatch(c, count, buf, bufLen, used);
+	if (made < 0)
 	{
-		// copy a char from '*newpass' string to the version to include spaces '*s_newpass'
-		*(s_newpass+s) = *(newpass+n);
+		fprintf(stderr,"ERROR: %s\n",sugError(c));
+		exit(EXIT_FAILURE);
+	}
+	return made;
+}
 
-		//printf("Password char is: %c with spaces char: %c @ %d and space count at %d\n", *newpass, *(s_newpass+s), s, addspc);
+/**-------- FUNCTION: shardStart
 
-		if (debug)
-		{
-			mvprintw(25+s,1,"char '%c' copied @ string location: %d and count: %d\n", *(newpass+n), s, addspc );
-			refresh();
-		}
+   number of the first password of part 'i' (from 0) when a run of
+   'total' passwords is split into 'n' parts - as near equal as can be.
+   Worked out so that nothing overflows: the remainder times 'i' is
+   less than n * n.
 
-		// if we are at the third character as we loop
-		if ( (addspc == 3) & (s != length-2 ) )
+*/
+
+long long shardStart(long long total, long long i, long long n)
+{
+	return ((total / n) * i) + (((total % n) * i) / n);
+}
+
+/**-------- FUNCTION: useSpare
+
+   with '--seed' switch the context 'c' to the passwords past the end
+   of the whole run - once, when passwords are first needed in place of
+   repeats dropped by '--unique'. So replacements are always the same
+   for the same seed.
+
+*/
+
+void useSpare(sugContext *c)
+{
+	if (!seed || spareInUse) return;
+	sugSeek(c, spareStart);
+	spareInUse = 1;
+}
+
+/**-------- FUNCTION: writeAll
+
+   write the whole of the buffer provided to the file descriptor 'fd',
+   retrying on partial writes and on interruption by a signal.
+   Exits the program if the write fails - eg stdout closed by a pipe
+
+*/
+
+void writeAll(int fd, const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		STAT_START(t);
+		ssize_t done = write(fd, buf, len);
+		STAT_STOP(t, cyclesOutput);
+		STAT_ADD(syscalls, 1);
+		if (done < 0)
 		{
-			// increment to the next char position
-			s++;
-			// assign a space at the new char location
-			*(s_newpass+s) = ' ';
-			// set to zero as will be incremented to 1 on loop exit - thus reset
-			if (debug)
-			{
-				mvprintw(25+s,5,"added space @ string location: %d and count: %d\n", s, addspc );
-				refresh();
-			}
-			// reset char count so we can loop back to 3 chars again as needed
-			addspc = 0;
+			if (errno == EINTR) continue;
+			fprintf(stderr,"Error writing output in writeAll(): %s\n",strerror(errno));
+			exit(EXIT_FAILURE);
 		}
+		STAT_ADD(bytesOut, done);
+		outOffset += (uint64_t)done;
+		buf += done;
+		len -= (size_t)done;
+	}
+}
 
-		// increament to next char position 
-		s++; n++;
-		// increment char space count by 1
-		addspc++;
+/**-------- FUNCTION: outputInit
 
-	}
-	// done - so terminate the new string with a NUL
-	*(s_newpass+s) = '\0';
+   choose how bulk output is written to 'fd': if it is a pipe, with
+   vmsplice() - which hands the pages of memory to the pipe rather than
+   copying them - otherwise with writev(). The pipe is made as large as
+   OUTBUF_SIZE if allowed, so it holds more of the output at once.
+
+*/
 
-	// display the complete password suggesiton created above
-	if (debug) { printf("\nNew password suggestion with spaces is: '%s'\n", s_newpass); }
-	return s_newpass;
+void outputInit(int fd)
+{
+#if defined(__linux__)
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) return;
+	fcntl(fd, F_SETPIPE_SZ, OUTBUF_SIZE);
+	spliceOut = 1;
+	if (debug) fprintf(stderr,"NB: output is a pipe of %d bytes - written with vmsplice()\n",fcntl(fd, F_GETPIPE_SZ));
+#else
+	(void)fd;
+#endif
 }
 
+/**-------- FUNCTION: writeOut
 
-/**-------- FUNCTION: dump
+   write all of the 'n' buffers in 'iov' to 'fd' as writeAll() does -
+   in as few system calls as it takes, with vmsplice() if outputInit()
+   chose it or writev(). 'iov' is changed as it is written. If the
+   pipe will not take vmsplice() writev() is used from then on.
 
-print out the complete list of words held in our words array
+   Memory given to vmsplice() is read from by the pipe's reader when it
+   gets to it: it must not be changed until outTaken() says so.
 
 */
 
+void writeOut(int fd, struct iovec *iov, int n)
+{
+	while (n > 0)
+	{
+		STAT_START(t);
+#if defined(__linux__)
+		ssize_t done = spliceOut ? vmsplice(fd, iov, (unsigned long)n, 0) : writev(fd, iov, n);
+#else
+		ssize_t done = writev(fd, iov, n);
+#endif
+		STAT_STOP(t, cyclesOutput);
+		STAT_ADD(syscalls, 1);
+		if (done < 0)
+		{
+			if (errno == EINTR) continue;
+			if (spliceOut && errno != EPIPE)
+			{
+				if (debug) fprintf(stderr,"NB: vmsplice() failed (%s) - using writev()\n",strerror(errno));
+				spliceOut = 0;
+				continue;
+			}
+			fprintf(stderr,"Error writing output in writeOut(): %s\n",strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		if (spliceOut) spliced = 1;
+		STAT_ADD(bytesOut, done);
+		outOffset += (uint64_t)done;
+		// step over what was written
+		size_t left = (size_t)done;
+		while (n > 0 && left >= iov->iov_len)
+		{
+			left -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + left;
+			iov->iov_len -= left;
+		}
+	}
+}
+
+/**-------- FUNCTION: outTaken / outWait
 
-void dumpWords()
+   with vmsplice() output to the pipe 'fd': whether the reader has
+   taken all the output up to byte 'end' (counted by outOffset), so the
+   memory it was written from may be made into again - as the pipe
+   holds the last bytes written, that is when fewer than outOffset -
+   'end' bytes are still in it. Also true if the reader has gone, as
+   the next write fails and reports that. outWait() waits until it is.
+
+*/
+
+int outTaken(int fd, uint64_t end)
 {
-	int i = 0;
+#if defined(__linux__)
+	int unread = 0;
+	if (!spliced || ioctl(fd, FIONREAD, &unread) != 0 || (uint64_t)unread <= outOffset - end) return 1;
+	struct pollfd p = { fd, POLLOUT, 0 };
+	return poll(&p, 1, 0) > 0 && (p.revents & POLLERR);
+#else
+	(void)fd; (void)end;
+	return 1;
+#endif
+}
 
-	while (i < wordArraySize ) 
+void outWait(int fd, uint64_t end)
+{
+	for (int spins = 0; !outTaken(fd, end); spins++)
 	{
-		printf("%s ", *(words+i));
-		i++;
+		if (spins < 64) sched_yield(); else usleep(100);
 	}
-	printf("\n");
+}
 
+/**-------- FUNCTION: writePasswords
 
-	// if debug printout first, middle and last words in our array
-	if (debug)
-	{
-		printf("Words array contains %d words -where:\n", wordArraySize);
-		printf("\tFirst word is 'aah'? : %s\n", *(words+0));
-		printf("\tMiddle word is %d is : %s\n", (wordArraySize/2), *(words+((wordArraySize/2)-1)) );		
-		printf("\tLast word is 'zzz'? : %s\n", *(words+wordArraySize-1));
+   write the 'len' bytes of passwords (one per line) at 'buf' to 'fd'
+   with writeAll() - or with '--hash' as 'password<TAB>hash' lines,
+   made by sugHashBatch() of context 'c' into 'hashBuf' of 'hashLen'
+   bytes and written as many lines at a time as fit
+
+*/
 
+void writePasswords(sugContext *c, int fd, const char *buf, size_t len, char *hashBuf, size_t hashLen)
+{
+	if (!hashing)
+	{
+		writeAll(fd, buf, len);
+		return;
+	}
+	size_t extra = sugHashLength(c) + 1;
+	while (len > 0)
+	{
+		// take the lines that will fit in 'hashBuf' with their hashes
+		size_t take = 0, room = hashLen - 1;
+		while (take < len)
+		{
+			const char *eol = memchr(buf + take, '\n', len - take);
+			size_t l = (size_t)(eol - (buf + take)) + 1;
+			if (l + extra > room) break;
+			room -= l + extra;
+			take += l;
+		}
+		size_t used;
+		if (take == 0 || sugHashBatch(c, buf, take, hashBuf, hashLen, &used) < 0)
+		{
+			fprintf(stderr,"ERROR: %s\n",take ? sugError(c) : "password is too long to hash");
+			exit(EXIT_FAILURE);
+		}
+		writeAll(fd, hashBuf, used);
+		buf += take;
+		len -= take;
 	}
 }
 
-/**-------- FUNCTION: getRandom
- 
-	gets a random password
+/*-----------------------*/
+/* UNIQUE OUTPUT         */
+/*-----------------------*/
 
-	get a random value within the wordArraySize using recommended: 
-	    rand() / (RAND_MAX / N + 1)
-	See C FAQ here: http://c-faq.com/lib/randrange.html
+/*
+	uniqueSet is the set of passwords already output by '--unique'. Each
+	password is reduced to a 64 bit key by uniqueKey() and the keys are
+	kept in an open addressing hash table with linear probing - 8 bytes
+	per slot, never more than two thirds full, and a key of 0 marks an
+	empty slot. It never grows: it is made big enough for all the
+	passwords to be output up front.
+*/
+typedef struct uniqueSet {
+	uint64_t *slot;     // the table - 'mask' + 1 slots
+	size_t mask;        // slots - 1 (slots is a power of 2)
+	int shift;          // 64 - log2(slots) - to take the top bits of a hash
+} uniqueSet;
+
+/* Fibonacci hashing multiplier - 2^64 / golden ratio */
+#define UNIQUE_MIX 0x9e3779b97f4a7c15ULL
+/* a second multiplier to pick partitions for '--unique' spill files - so
+   the keys of a partition are still spread over all of its table */
+#define UNIQUE_PART_MIX 0xbf58476d1ce4e5b9ULL
+/* longest password packed exactly into a key - 12 letters of 5 bits */
+#define UNIQUE_PACK_LEN 12
+/* passwords in a row that were all already output before giving up */
+#define UNIQUE_STALE (1 << 20)
+
+/**-------- FUNCTION: uniqueKey
+
+   the 64 bit key for the password 'pw' of 'len' characters. A password
+   of up to 12 lower case letters - so every password of four three
+   letter words - is packed exactly, 5 bits per letter, so two keys are
+   only equal if the passwords are. Other passwords use a 64 bit hash,
+   with the top bit set so it can never equal a packed key. Two of those
+   sharing a hash is so unlikely (about 1 in 10^19 per pair) that it is
+   ignored: it would only cause a password to be replaced needlessly.
+   Keys are made from the password's characters rather than its word
+   numbers, as different words can make the same password - 'a'+'bc'
+   and 'ab'+'c' - and word lists may repeat a word.
 
 */
 
-char *getRandom(int wordsRequired)
+static inline uint64_t uniqueKey(const char *pw, size_t len)
 {
-	// Allocate a new char pointer (string) to hold the generated password
-	// will be allocated on the heap - so will exist after function ends
-	// words are three chars in length times number words required + 1 for '\0'
-	char *genPass = malloc( ((sizeof(char)*3) * wordsRequired) + 1 );
-	// if malloc() failed - exit
-	if (genPass == NULL) 
+	if (len <= UNIQUE_PACK_LEN)
 	{
-		fprintf(stderr,"Error allocating memory in getRandom(): %s\n",strerror(errno));
-		exit(EXIT_FAILURE); 
+		uint64_t k = 0;
+		size_t i = 0;
+		for (; i < len && pw[i] >= 'a' && pw[i] <= 'z'; i++) k = (k << 5) | (uint64_t)(pw[i] - 'a' + 1);
+		if (i == len) return k;
 	}
-	// initialise our new malloc variable so works with strncat
-	*genPass = '\0';
-
-	for ( int x = 1; x <= wordsRequired; x++ )
+	uint64_t h = 0xcbf29ce484222325ULL ^ len;
+	for (; len >= 8; len -= 8, pw += 8)
 	{
-		// get a random number based on the size of the word array
-		int r = rand() / (RAND_MAX / wordArraySize +1);
-		// if debug - print out the randowm number obtained
-		// and the corresponding word in the aray at that location
-		if (debug) { printf("Random number generated is: %d with word: '%s'\n", r, *(words+r)); }
-		// add the new word to the 'genPass' variable we allocated on heap earlier
-		strncat( genPass, *(words+r), strlen(*(words+r)) );
+		uint64_t v;
+		memcpy(&v, pw, 8);
+		h = (h ^ v) * UNIQUE_MIX;
+		h ^= h >> 29;
 	}
-	// display the complete password suggesiton created above
-	if (debug) { printf("\nNew password suggestion: '%s'\n", genPass); }
-	// return the memory address of variable: char *genPass
-	return genPass;
+	for (; len > 0; len--, pw++) h = (h ^ (unsigned char)*pw) * 0x100000001b3ULL;
+	h ^= h >> 32;
+	h *= UNIQUE_MIX;
+	h ^= h >> 29;
+	return h | (1ULL << 63);
 }
 
+/**-------- FUNCTION: recordKey
 
-/**-------------------------------*/
-/* MAIN - Program starts here    */
-/*-------------------------------*/
+   the uniqueKey() of the password in the output record 'rec' of 'len'
+   bytes (without its recordEnd) - found by sugRecordPassword() for
+   the '--format', or if 'hashed' the record is 'password<TAB>hash'
+   and the password is before the last tab, as a hash has none
 
-int main(int argc, char **argv)
+*/
+
+static inline uint64_t recordKey(const char *rec, size_t len, int hashed)
 {
-	// register our atexit() function
-	atexit(exitCleanup);
+	if (hashed)
+	{
+		const char *tab = memrchr(rec, '\t', len);
+		return uniqueKey(rec, tab ? (size_t)(tab - rec) : len);
+	}
+	size_t pwLen;
+	const char *pw = sugRecordPassword(ctx, rec, len, &pwLen);
+	return uniqueKey(pw, pwLen);
+}
 
-	// get any command line arguments provided by the user
-	getCLIArgs(argc,argv);
+/**-------- FUNCTION: uniqueSetBytes
 
-	// get total number of 3 letter words in our array
-	//    *word [wordArraySize] [4]
-	wordArraySize = sizeof(words)/sizeof(words[0]);
+   bytes of memory a uniqueSet needs to hold 'count' passwords
 
-	// if debug - then print out size of our word array
-	if (debug) { printf("\tWord array size is: %d\n", wordArraySize); }
+*/
 
-	// seed random with the current time in seconds since the Epoch
-	// done once - used as is global value for programs life
-	srand(time(NULL));
+size_t uniqueSetBytes(long long count)
+{
+	size_t slots = 1024;
+	while (slots < (size_t)count + ((size_t)count / 2)) slots *= 2;
+	return slots * sizeof(uint64_t);
+}
 
-	// if quick output was requested via command line option '-q' then
-	// output a password suggestion and exist. Ignore other options
-	// except debug, and password suggestion length
-	if (quick){
-		if (debug) printf("NB: Quick password requested with '-q' option\n");
-		char *newpass = getRandom(wordsRequired);
-		printf("%s\n",newpass);
-		free(newpass); newpass= NULL;
-		return EXIT_SUCCESS;
+/**-------- FUNCTION: uniqueInit / uniqueFree
+
+   make the set 'u' big enough to hold 'count' passwords - and free it
+
+*/
+
+void uniqueInit(uniqueSet *u, long long count)
+{
+	size_t bytes = uniqueSetBytes(count);
+	u->slot = calloc(1, bytes);
+	if (u->slot == NULL)
+	{
+		fprintf(stderr,"Error allocating memory in uniqueInit(): %s\n",strerror(errno));
+		exit(EXIT_FAILURE);
 	}
+	u->mask = (bytes / sizeof(uint64_t)) - 1;
+	u->shift = 64;
+	for (size_t s = u->mask + 1; s > 1; s >>= 1) u->shift--;
+}
 
-	// RUN AS NCURSES PROGRAM FROM HERE:
-	// startup a ncurses window to display output
-	initscr();
-	// display some info about the program
-	centerText(2,"Suggest Password Program");
-	centerText(3,version);
+void uniqueFree(uniqueSet *u)
+{
+	free(u->slot); u->slot = NULL;
+}
 
-	mvprintw(6,1, "Application Stats:");
-	mvprintw(7,2, "- Number of three letter words available:");
-	mvprintw(7,45,"%d", wordArraySize);
-	mvprintw(8,2, "- Number of words per suggested password:");
-	mvprintw(8,45,"%d",wordsRequired);
-	mvprintw(9,2, "- Password character length will be:");
-	mvprintw(9,45, "%d", (wordsRequired * 3));
-	mvprintw(10,2, "- Number of password suggesions to offer:");
-	mvprintw(10,45, "%d", numPassSuggestions);
-	refresh();
+/**-------- FUNCTION: uniqueAdd
 
-	
-	// mvprintw((LINES-2),1, "ROW: %d | COL: %d | TYPED: %d",row,col,typed);
-	// get the password suggestions
-	mvprintw(12,4, "Suggested passwords are:");
-	mvprintw(14,12, "Password:");
-	mvprintw(14,25+(wordsRequired * 3), "Password (with spaces):");
-	for (int x = 1; x <= numPassSuggestions; x++)
+   add 'key' to the set 'u' - returns 1 if it was added, or 0 if it
+   was already there
+
+*/
+
+static inline int uniqueAdd(uniqueSet *u, uint64_t key)
+{
+	size_t i = (size_t)((key * UNIQUE_MIX) >> u->shift);
+	for (;;)
 	{
-		char *newpass = getRandom(wordsRequired);
-		char *spc_newpass = withSpaces(newpass);
-		mvprintw(15+x,12,"%s", newpass);
-		mvprintw(15+x,25+(wordsRequired * 3),"%s", spc_newpass );
-		// finished with *newpass and *spc_newpass now - so free memory up
-		free(newpass); newpass = NULL;
-		free(spc_newpass); spc_newpass = NULL;
+		uint64_t k = u->slot[i];
+		if (k == key) return 0;
+		if (k == 0)
+		{
+			u->slot[i] = key;
+			return 1;
+		}
+		i = (i + 1) & u->mask;
 	}
+}
+
+/**-------- FUNCTION: uniqueInsert
+
+   add all of the 'len' bytes of password records at 'buf' to the set
+   'u'
+
+*/
 
+void uniqueInsert(uniqueSet *u, const char *buf, size_t len)
+{
+	for (const char *in = buf, *end = buf + len; in < end; )
+	{
+		const char *eol = memchr(in, recordEnd, end - in);
+		uniqueAdd(u, recordKey(in, (size_t)(eol - in), 0));
+		in = eol + 1;
+	}
+}
+
+/**-------- FUNCTION: uniqueFilter
+
+   remove from the 'len' bytes of password records at 'buf' every
+   password already in the set 'u', and add the rest to it. The records
+   kept are moved up to close the gaps, and '*newLen' is set to the
+   bytes left. Returns the number of passwords kept. If 'hashed' is set
+   the records are 'password<TAB>hash' - see recordKey().
+
+*/
+
+long long uniqueFilter(uniqueSet *u, char *buf, size_t len, size_t *newLen, int hashed)
+{
+	char *in = buf, *out = buf, *end = buf + len;
+	long long kept = 0;
+	while (in < end)
+	{
+		char *eol = memchr(in, recordEnd, end - in);
+		size_t l = (size_t)(eol - in) + 1;
+		if (uniqueAdd(u, recordKey(in, l - 1, hashed)))
+		{
+			if (out != in) memmove(out, in, l);
+			out += l;
+			kept++;
+		}
+		else
+		{
+			STAT_ADD(duplicates, 1);
+		}
+		in = eol + 1;
+	}
+	*newLen = (size_t)(out - buf);
+	return kept;
+}
+
+/**-------- FUNCTION: uniqueStale
+
+   count a batch of 'made' passwords that gave 'kept' new ones - and
+   exit if UNIQUE_STALE passwords in a row were all already output, as
+   then almost every password that can be made has been
+
+*/
+
+void uniqueStale(long long made, long long kept, long long *stale)
+{
+	*stale = kept > 0 ? 0 : *stale + made;
+	if (*stale >= UNIQUE_STALE)
+	{
+		fprintf(stderr,"ERROR: unable to find more unique passwords - use more words with '-w'\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**-------- FUNCTION: bulkPasswordsSpill
+
+   output 'count' unique passwords made with context 'c' to 'fd' when
+   a uniqueSet for all of them would need more than 'memLimit' bytes.
+
+   The passwords are made in one pass and spread over temporary files
+   ('partitions') by their key, so the same password always lands in
+   the same partition. There are enough partitions that the set of
+   one fits in 'memLimit', and each is read back SPILL_CHUNK bytes at a
+   time - so however big a partition file grows only its set is held
+   in memory while its duplicates are removed and the rest output.
+   Passwords to replace the duplicates are spread over the partitions
+   in the same way, and checked against what each already holds -
+   repeated until none are needed. Output is in partition order, not
+   the order passwords were made - which is still random.
+
+*/
+
+#define SPILL_MAX_PARTS 1024
+/* bytes of a partition file read back at a time */
+#define SPILL_CHUNK (256 * 1024)
+
+void bulkPasswordsSpill(sugContext *c, long long count, int fd, size_t memLimit)
+{
+	int parts = 2, bits = 1;
+	while (parts < SPILL_MAX_PARTS && uniqueSetBytes(count / parts) + SPILL_CHUNK > memLimit) { parts *= 2; bits++; }
+	if (debug) fprintf(stderr,"NB: --unique is using %d temporary files\n",parts);
+
+	FILE **part = xmalloc(sizeof(FILE *) * parts, "bulkPasswordsSpill");
+	long long *lines = xmalloc(sizeof(long long) * parts, "bulkPasswordsSpill");
+	off_t *done = xmalloc(sizeof(off_t) * parts, "bulkPasswordsSpill");
+	for (int p = 0; p < parts; p++)
+	{
+		part[p] = tmpfile();
+		if (part[p] == NULL)
+		{
+			fprintf(stderr,"ERROR: unable to create temporary file for --unique: %s\n",strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		lines[p] = 0;
+		done[p] = 0;
+	}
+	char *outBuf = xmalloc(OUTBUF_SIZE, "bulkPasswordsSpill");
+	char *chunk = xmalloc(SPILL_CHUNK, "bulkPasswordsSpill");
+	long long stale = 0;
+
+	for (long long missing = count; missing > 0; )
+	{
+		// make the passwords still needed and spread them over the partitions
+		if (missing < count) useSpare(c);
+		for (long long left = missing; left > 0; )
+		{
+			size_t used;
+			left -= xgenerate(c, left, outBuf, OUTBUF_SIZE, &used);
+			for (char *in = outBuf, *end = outBuf + used; in < end; )
+			{
+				char *eol = memchr(in, recordEnd, end - in);
+				size_t l = (size_t)(eol - in) + 1;
+				int p = (int)((recordKey(in, l - 1, 0) * UNIQUE_PART_MIX) >> (64 - bits));
+				if (fwrite(in, 1, l, part[p]) != l)
+				{
+					fprintf(stderr,"ERROR: unable to write temporary file for --unique: %s\n",strerror(errno));
+					exit(EXIT_FAILURE);
+				}
+				lines[p]++;
+				in = eol + 1;
+			}
+		}
+
+		// output the new passwords in each partition that are not already there
+		long long kept = 0;
+		for (int p = 0; p < parts; p++)
+		{
+			fflush(part[p]);
+			off_t size = ftello(part[p]);
+			if (size == done[p]) continue;
+			uniqueSet u;
+			uniqueInit(&u, lines[p]);
+			for (off_t at = 0; at < size; )
+			{
+				// a chunk never spans the end of the earlier rounds' passwords
+				off_t upTo = at < done[p] ? done[p] : size;
+				size_t want = upTo - at < SPILL_CHUNK ? (size_t)(upTo - at) : SPILL_CHUNK;
+				if (pread(fileno(part[p]), chunk, want, at) != (ssize_t)want)
+				{
+					fprintf(stderr,"ERROR: unable to read temporary file for --unique: %s\n",strerror(errno));
+					exit(EXIT_FAILURE);
+				}
+				// whole records only - the rest is read again with the next chunk
+				size_t len = want;
+				while (len > 0 && chunk[len - 1] != recordEnd) len--;
+				if (len == 0)
+				{
+					fprintf(stderr,"ERROR: password is too long for --unique temporary files\n");
+					exit(EXIT_FAILURE);
+				}
+				if (at < done[p])
+				{
+					// passwords from earlier rounds are all output (or repeats
+					// of ones that are) - so they just go in the set
+					uniqueInsert(&u, chunk, len);
+				}
+				else
+				{
+					size_t newLen;
+					kept += uniqueFilter(&u, chunk, len, &newLen, 0);
+					writePasswords(c, fd, chunk, newLen, outBuf, OUTBUF_SIZE);
+				}
+				at += (off_t)len;
+			}
+			uniqueFree(&u);
+			done[p] = size;
+		}
+		uniqueStale(missing, kept, &stale);
+		missing -= kept;
+	}
+
+	for (int p = 0; p < parts; p++) fclose(part[p]);
+	free(chunk); chunk = NULL;
+	free(outBuf); outBuf = NULL;
+	free(done); free(lines); free(part);
+}
+
+
+/**-------- FUNCTION: bulkPasswords
+
+   output 'count' password suggestions made with context 'c', one
+   record of the '--format' each, to the file descriptor 'fd' (normally
+   stdout).
+
+   Passwords are built directly into one large reusable output buffer
+   by sugFormatBatch() which is only flushed by writeOut() when full,
+   so a run of millions of passwords costs a handful of system calls
+   and no allocations once the buffer memory is obtained. With
+   '--unique' each batch is filtered through the set 'seen' of
+   passwords already output, and more are made to replace any removed.
+   With '--hash' each batch is then hashed into a second buffer, and
+   is made small enough for it to hold the hashes too. With vmsplice()
+   the pipe goes on using the buffers after they are written, so two
+   sets are used in turn - each made into again only once the pipe's
+   reader has taken what was written from it.
+
+*/
+
+void bulkPasswords(sugContext *c, long long count, int fd)
+{
+	// each record is the longest password record - and any hash
+	size_t lineLen = sugRecordLength(c) + (hashing ? sugHashLength(c) + 1 : 0);
+	if (lineLen + 1 > OUTBUF_SIZE)
+	{
+		fprintf(stderr,"ERROR: password of %d words is too long for bulk output\n",sugWords(c));
+		exit(EXIT_FAILURE);
+	}
+	int sets = spliceOut ? 2 : 1;
+	size_t setSize = hashing ? 2 * OUTBUF_SIZE : OUTBUF_SIZE;
+	char *bufs = xmalloc(setSize * sets, "bulkPasswords");
+	uint64_t setEnd[2] = { 0, 0 };
+	long long perBatch = hashing ? (long long)((OUTBUF_SIZE - 1) / lineLen) : count;
+
+	long long stale = 0;
+	// passwords still to make before any are replacements
+	long long first = count;
+	for (int set = 0; count > 0; set = (set + 1) % sets)
+	{
+		char *outBuf = bufs + (setSize * set);
+		size_t used;
+		outWait(fd, setEnd[set]);
+		if (first <= 0) useSpare(c);
+		long long made = xgenerate(c, count < perBatch ? count : perBatch, outBuf, OUTBUF_SIZE, &used);
+		first -= made;
+		// with '--unique' drop any already output - the loop makes more
+		if (seen)
+		{
+			long long kept = uniqueFilter(seen, outBuf, used, &used, 0);
+			uniqueStale(made, kept, &stale);
+			made = kept;
+		}
+		struct iovec iov = { outBuf, used };
+		if (hashing)
+		{
+			iov.iov_base = outBuf + OUTBUF_SIZE;
+			if (sugHashBatch(c, outBuf, used, iov.iov_base, OUTBUF_SIZE, &iov.iov_len) < 0)
+			{
+				fprintf(stderr,"ERROR: %s\n",sugError(c));
+				exit(EXIT_FAILURE);
+			}
+		}
+		writeOut(fd, &iov, 1);
+		setEnd[set] = outOffset;
+		count -= made;
+	}
+	outWait(fd, outOffset);
+	free(bufs); bufs = NULL;
+}
+
+
+/*
+	State shared by the threads of bulkPasswordsThreaded().
+
+	Output is cut into numbered chunks. Worker threads claim the next
+	chunk number from 'nextChunk', and chunk 'k' is always built in
+	slot (k % numSlots) of the ring. Each slot's 'seq' says what state
+	it is in without any locks:
+	    seq == k       slot is free for a worker to build chunk k
+	    seq == k + 1   chunk k is built and ready for the writer
+	and once the writer has output chunk k it sets seq to k + numSlots,
+	freeing the slot for the chunk that follows it round the ring. As
+	the writer takes chunks in number order, output stays in order.
+*/
+typedef struct {
+	_Atomic long long seq;   // state of the slot - see above
+	size_t len;              // bytes of output built in 'buf'
+	char *buf;               // CHUNK_SIZE bytes of output
+	uint64_t end;            // outOffset at the end of the chunk once written
+} chunkSlot;
+
+typedef struct {
+	chunkSlot *slots;             // the ring of chunk slots
+	long long numSlots;           // number of slots in the ring
+	long long count;              // total passwords to output
+	long long perChunk;           // passwords in each full chunk - sized for longest words
+	long long numChunks;          // total chunks to output
+	_Atomic long long nextChunk;  // next chunk number to be claimed
+	sugContext *ctx;              // settings each worker clones its context from
+	uint64_t first;               // with a seed - number of the first password
+	int hashed;                   // 1 == chunks are 'password<TAB>hash' lines
+} chunkQueue;
+
+/**-------- FUNCTION: waitForSeq
+
+   wait until the slot's sequence number reaches 'want' - spins
+   briefly then gives up the CPU between checks
+
+*/
+
+static void waitForSeq(chunkSlot *slot, long long want)
+{
+	int spins = 0;
+	while (atomic_load_explicit(&slot->seq, memory_order_acquire) != want)
+	{
+		if (++spins > 64) sched_yield();
+	}
+}
+
+/**-------- FUNCTION: bulkWorker
+
+   worker thread for bulkPasswordsThreaded() - owns its own context,
+   so its own random engine seeded independently, and builds chunks of
+   passwords until there are none left to claim. With '--seed' each
+   chunk is instead made from its own part of the seeded run - so the
+   output is the same however many threads are used. With '--hash' the
+   passwords are made in a buffer of the worker's own and hashed into
+   the chunk - so the hashing is spread over the threads too.
+
+*/
+
+void *bulkWorker(void *arg)
+{
+	chunkQueue *q = arg;
+	sugContext *c = sugClone(q->ctx);
+	if (c == NULL)
+	{
+		fprintf(stderr,"ERROR: unable to set up thread in bulkWorker(): %s\n",sugError(q->ctx));
+		exit(EXIT_FAILURE);
+	}
+	char *plain = q->hashed ? xmalloc(CHUNK_SIZE, "bulkWorker") : NULL;
+
+	for (;;)
+	{
+		long long k = atomic_fetch_add(&q->nextChunk, 1);
+		if (k >= q->numChunks) break;
+		chunkSlot *slot = &q->slots[k % q->numSlots];
+		waitForSeq(slot, k);
+
+		long long n = q->count - (k * q->perChunk);
+		if (n > q->perChunk) n = q->perChunk;
+		// with a seed make the chunk's own part of the run
+		sugSeek(c, q->first + (uint64_t)(k * q->perChunk));
+		if (plain)
+		{
+			size_t used;
+			xgenerate(c, n, plain, CHUNK_SIZE, &used);
+			if (sugHashBatch(c, plain, used, slot->buf, CHUNK_SIZE, &slot->len) < 0)
+			{
+				fprintf(stderr,"ERROR: %s\n",sugError(c));
+				exit(EXIT_FAILURE);
+			}
+		}
+		else
+		{
+			xgenerate(c, n, slot->buf, CHUNK_SIZE, &slot->len);
+		}
+		atomic_store_explicit(&slot->seq, k + 1, memory_order_release);
+	}
+	free(plain); plain = NULL;
+	sugFree(c);
+	sugStatsMerge();
+	return NULL;
+}
+
+/**-------- FUNCTION: bulkPasswordsThreaded
+
+   output 'count' password suggestions with the settings of context
+   'c' to 'fd' as bulkPasswords() does, but with 'threads' worker
+   threads generating chunks of the output in parallel. The calling
+   thread is the single writer, and takes the chunks from the workers
+   in order - see chunkQueue above - writing all that are ready with
+   one writeOut(). With vmsplice() a slot is only handed back once the
+   pipe's reader has taken its chunk.
+
+*/
+
+void bulkPasswordsThreaded(sugContext *c, long long count, int threads, int fd)
+{
+	// each record is the longest password record - and any hash
+	size_t lineLen = sugRecordLength(c) + (hashing ? sugHashLength(c) + 1 : 0);
+	if (lineLen + 1 > CHUNK_SIZE)
+	{
+		fprintf(stderr,"ERROR: password of %d words is too long for bulk output\n",sugWords(c));
+		exit(EXIT_FAILURE);
+	}
+
+	chunkQueue q;
+	q.ctx = c;
+	q.first = sugTell(c);
+	q.count = count;
+	q.hashed = hashing;
+	q.perChunk = (CHUNK_SIZE - 1) / lineLen;
+	q.numChunks = (count + q.perChunk - 1) / q.perChunk;
+	// two slots per worker - so each can build a chunk while its last is written
+	q.numSlots = 2 * threads;
+	atomic_init(&q.nextChunk, 0);
+	q.slots = xmalloc(sizeof(chunkSlot) * q.numSlots, "bulkPasswordsThreaded");
+	char *bufs = xmalloc((size_t)CHUNK_SIZE * q.numSlots, "bulkPasswordsThreaded");
+	pthread_t *workers = xmalloc(sizeof(pthread_t) * threads, "bulkPasswordsThreaded");
+	for (long long i = 0; i < q.numSlots; i++)
+	{
+		atomic_init(&q.slots[i].seq, i);
+		q.slots[i].len = 0;
+		q.slots[i].buf = bufs + ((size_t)CHUNK_SIZE * i);
+		q.slots[i].end = 0;
+	}
+
+	for (int t = 0; t < threads; t++)
+	{
+		int err = pthread_create(&workers[t], NULL, bulkWorker, &q);
+		if (err != 0)
+		{
+			fprintf(stderr,"Error starting thread in bulkPasswordsThreaded(): %s\n",strerror(err));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// writer: output the chunks in number order as they become ready -
+	// with '--unique' dropping passwords already output. Chunks before
+	// 'freed' have had their slots handed back
+	long long kept = 0, freed = 0;
+	struct iovec iov[WRITE_GATHER];
+	for (long long k = 0; k < q.numChunks; )
+	{
+		// chunk k is built in the slot of chunk k - numSlots - hand it back
+		for (; freed <= k - q.numSlots; freed++)
+		{
+			chunkSlot *old = &q.slots[freed % q.numSlots];
+			outWait(fd, old->end);
+			atomic_store_explicit(&old->seq, freed + q.numSlots, memory_order_release);
+		}
+		waitForSeq(&q.slots[k % q.numSlots], k + 1);
+		// take every chunk from k on that is ready
+		int n = 0;
+		uint64_t end = outOffset;
+		for (; n < WRITE_GATHER && k + n < q.numChunks; n++)
+		{
+			chunkSlot *slot = &q.slots[(k + n) % q.numSlots];
+			if (n > 0 && atomic_load_explicit(&slot->seq, memory_order_acquire) != k + n + 1) break;
+			if (seen) kept += uniqueFilter(seen, slot->buf, slot->len, &slot->len, q.hashed);
+			iov[n].iov_base = slot->buf;
+			iov[n].iov_len = slot->len;
+			end += slot->len;
+			slot->end = end;
+		}
+		writeOut(fd, iov, n);
+		k += n;
+		// hand back the slots of chunks the pipe is done with
+		for (; freed < k && outTaken(fd, q.slots[freed % q.numSlots].end); freed++)
+		{
+			atomic_store_explicit(&q.slots[freed % q.numSlots].seq, freed + q.numSlots, memory_order_release);
+		}
+	}
+
+	for (int t = 0; t < threads; t++) pthread_join(workers[t], NULL);
+	outWait(fd, outOffset);
+	free(workers); workers = NULL;
+	free(bufs); bufs = NULL;
+	free(q.slots); q.slots = NULL;
+	// replace any duplicates removed by '--unique' - numbered after the run
+	if (seen && kept < count)
+	{
+		sugSeek(c, q.first + (uint64_t)count);
+		useSpare(c);
+		bulkPasswords(c, count - kept, fd);
+	}
+}
+
+
+
+/*-----------------------*/
+/* ENCODING              */
+/*-----------------------*/
+
+/**-------- FUNCTION: parseNumber
+
+   read the number 'text' for '--encode' into the big endian bytes at
+   'num' (SUG_CODE_MAX of them), and set '*len' to the bytes it takes:
+   8 for a decimal number (so every 64 bit number is encoded with the
+   same number of words), or half a byte per digit for hex starting
+   '0x' - so byte strings of any length up to SUG_CODE_MAX can be given
+   as hex. Returns -1 if 'text' is not a number that fits.
+
+*/
+
+int parseNumber(const char *text, unsigned char *num, size_t *len)
+{
+	if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+	{
+		const char *hex = text + 2;
+		size_t digits = strlen(hex);
+		if (digits == 0 || digits > 2 * SUG_CODE_MAX || strspn(hex, "0123456789abcdefABCDEF") != digits) return -1;
+		*len = (digits + 1) / 2;
+		memset(num, 0, *len);
+		// fill from the last digit back, so an odd digit count gets a leading zero
+		for (size_t i = 0; i < digits; i++)
+		{
+			char ch = hex[digits - 1 - i];
+			int v = isdigit((unsigned char)ch) ? ch - '0' : (tolower((unsigned char)ch) - 'a' + 10);
+			num[*len - 1 - (i / 2)] |= (unsigned char)(v << (4 * (i % 2)));
+		}
+		return 0;
+	}
+	if (!isdigit((unsigned char)text[0])) return -1;
+	char *end;
+	errno = 0;
+	unsigned long long v = strtoull(text, &end, 10);
+	if (*end != '\0' || errno == ERANGE) return -1;
+	*len = 8;
+	for (int i = 7; i >= 0; i--, v >>= 8) num[i] = (unsigned char)v;
+	return 0;
+}
+
+/**-------- FUNCTION: printNumber
+
+   output the number in the 'len' big endian bytes at 'num' for
+   '--decode' - in decimal if it fits in 64 bits, otherwise in hex
+   starting '0x' with no leading zero bytes
+
+*/
+
+void printNumber(const unsigned char *num, size_t len)
+{
+	size_t first = 0;
+	while (first < len - 1 && num[first] == 0) first++;
+	if (len - first <= 8)
+	{
+		unsigned long long v = 0;
+		for (size_t i = first; i < len; i++) v = (v << 8) | num[i];
+		printf("%llu\n", v);
+		return;
+	}
+	printf("0x");
+	for (size_t i = first; i < len; i++) printf("%02x", num[i]);
+	printf("\n");
+}
+
+/**-------- FUNCTION: codeValues
+
+   '--encode' or (if 'decode' is set) '--decode' each of the 'count'
+   values in 'args' - or if there are none, each line read from stdin.
+   Encoding turns a number into a password, decoding a password back
+   into its number - see sugEncode(). A value that fails is reported
+   on stderr and the rest carry on. Returns the exit status: failure
+   if any value failed.
+
+*/
+
+int codeValues(sugContext *c, int decode, char **args, int count)
+{
+	int status = EXIT_SUCCESS;
+	size_t outLen = (size_t)(8 * SUG_CODE_MAX) * (c->dict->maxLen + 1) + 1;
+	char *out = xmalloc(outLen, "codeValues");
+	char *line = NULL;
+	size_t lineCap = 0;
+	for (int i = 0; ; i++)
+	{
+		char *value;
+		if (count > 0)
+		{
+			if (i == count) break;
+			value = args[i];
+		}
+		else
+		{
+			ssize_t got = getline(&line, &lineCap, stdin);
+			if (got < 0) break;
+			while (got > 0 && (line[got-1] == '\n' || line[got-1] == '\r')) line[--got] = '\0';
+			if (got == 0) continue;
+			value = line;
+		}
+
+		unsigned char num[SUG_CODE_MAX];
+		size_t len;
+		if (decode)
+		{
+			if (sugDecode(c, value, num, sizeof(num)) < 0)
+			{
+				fprintf(stderr,"ERROR: %s\n",sugError(c));
+				status = EXIT_FAILURE;
+				continue;
+			}
+			printNumber(num, sizeof(num));
+		}
+		else if (parseNumber(value, num, &len) != 0)
+		{
+			fprintf(stderr,"ERROR: '%s' is not a decimal number below 2^64 or a hex number starting 0x of up to %d bytes\n",
+				value, SUG_CODE_MAX);
+			status = EXIT_FAILURE;
+		}
+		else if (sugEncode(c, num, len, wordsGiven ? sugWords(c) : 0, out, outLen) < 0)
+		{
+			fprintf(stderr,"ERROR: %s\n",sugError(c));
+			status = EXIT_FAILURE;
+		}
+		else
+		{
+			printf("%s\n", out);
+		}
+	}
+	free(line); line = NULL;
+	free(out); out = NULL;
+	return status;
+}
+
+
+
+/*-----------------------*/
+/* SERVER                */
+/*-----------------------*/
+
+/* passwords held ready in each server thread's pool */
+#define POOL_SIZE 4096
+/* pool is refilled once it falls to this many passwords */
+#define POOL_LOW (POOL_SIZE / 2)
+/* longest request line accepted */
+#define SERVE_LINE_MAX 1024
+/* most passwords given for one request */
+#define SERVE_MAX_COUNT 10000
+/* most output held for a client before its requests are no longer read */
+#define SERVE_OUT_MAX (4 * 1024 * 1024)
+/* most events handled from one epoll_wait() */
+#define SERVE_EVENTS 64
+
+#if defined(__linux__)
+
+/* set by SIGINT or SIGTERM to stop the server */
+volatile sig_atomic_t serveStop = 0;
+
+/*
+	passPool is a ring of passwords made ahead of time with the
+	server's settings, so a request can be answered by copying them
+	out. It has one reader (the server thread) and one writer (its
+	refill thread), so no locks are needed to take or add passwords:
+	passwords 'head' up to 'tail' are ready, and only the reader moves
+	'head' and only the writer moves 'tail'. The lock is only used for
+	the refill thread to sleep while the pool is more than POOL_LOW full.
+*/
+typedef struct {
+	char *buf;                // POOL_SIZE slots of 'slotLen' bytes - each a password and '\n'
+	uint32_t *len;            // length of the password in each slot - with the '\n'
+	size_t slotLen;           // bytes in each slot
+	_Atomic size_t head;      // next password to take
+	_Atomic size_t tail;      // next slot to fill
+	pthread_mutex_t lock;     // with 'wake' - lets the refill thread sleep
+	pthread_cond_t wake;      // signalled when the pool falls to POOL_LOW
+	int stop;                 // set (with 'lock' held) to end the refill thread
+	sugContext *ctx;          // refill thread's own context
+	pthread_t thread;         // the refill thread
+} passPool;
+
+/* a server thread - each has its own event loop, contexts and pool */
+typedef struct {
+	int listenFd;             // the listening socket - shared by all server threads
+	sugContext *ctx;          // server's settings - used when the pool is empty
+	sugContext *custom;       // for requests that give their own settings
+	passPool pool;            // passwords made ahead with 'ctx' settings
+	pthread_t thread;         // the thread running serveLoop()
+} serveThread;
+
+/* a client connection */
+typedef struct {
+	int fd;                   // the client's socket
+	int closing;              // 1 == client has finished sending - close once output sent
+	uint32_t events;          // epoll events currently waited for
+	size_t inLen;             // bytes of an unfinished request line in 'in'
+	char in[SERVE_LINE_MAX];  // request line being read
+	char *out;                // output waiting to be sent
+	size_t outLen;            // bytes in 'out'
+	size_t outSent;           // bytes of 'out' already sent
+	size_t outCap;            // bytes allocated at 'out'
+} serveConn;
+
+/**-------- FUNCTION: serveSignal
+
+   signal handler for SIGINT and SIGTERM - the server threads see the
+   flag within a quarter of a second and stop
+
+*/
+
+void serveSignal(int sig)
+{
+	(void)sig;
+	serveStop = 1;
+}
+
+/**-------- FUNCTION: poolRefill
+
+   refill thread for a passPool - fills every free slot, then sleeps
+   until the server thread has taken the pool down to POOL_LOW. Each
+   password is handed over as soon as it is made.
+
+*/
+
+void *poolRefill(void *arg)
+{
+	passPool *p = arg;
+	for (;;)
+	{
+		pthread_mutex_lock(&p->lock);
+		while (!p->stop && atomic_load(&p->tail) - atomic_load(&p->head) > POOL_LOW)
+		{
+			pthread_cond_wait(&p->wake, &p->lock);
+		}
+		int stop = p->stop;
+		pthread_mutex_unlock(&p->lock);
+		// the thread also ends if no more passwords can be made (see
+		// generatePassword()) - requests are then answered with the reason
+		if (stop || p->ctx->failed) break;
+
+		size_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+		while (tail - atomic_load_explicit(&p->head, memory_order_acquire) < POOL_SIZE)
+		{
+			size_t i = tail % POOL_SIZE, slen;
+			char *slot = p->buf + (i * p->slotLen);
+			size_t len = generatePassword(p->ctx, slot, NULL, &slen);
+			if (p->ctx->failed) break;
+			slot[len] = '\n';
+			p->len[i] = (uint32_t)len + 1;
+			atomic_store_explicit(&p->tail, ++tail, memory_order_release);
+		}
+	}
+	sugStatsMerge();
+	return NULL;
+}
+
+/**-------- FUNCTION: poolStart / poolStop
+
+   set up the pool 'p' to hold passwords made with the settings of
+   context 'c', and start its refill thread - and later stop the
+   thread and free the pool
+
+*/
+
+void poolStart(passPool *p, sugContext *c)
+{
+	p->slotLen = sugMaxLength(c) + 1;
+	p->buf = xmalloc(p->slotLen * POOL_SIZE, "poolStart");
+	p->len = xmalloc(sizeof(uint32_t) * POOL_SIZE, "poolStart");
+	atomic_init(&p->head, 0);
+	atomic_init(&p->tail, 0);
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->wake, NULL);
+	p->stop = 0;
+	p->ctx = sugClone(c);
+	if (p->ctx == NULL)
+	{
+		fprintf(stderr,"ERROR: unable to set up pool in poolStart(): %s\n",sugError(c));
+		exit(EXIT_FAILURE);
+	}
+	int err = pthread_create(&p->thread, NULL, poolRefill, p);
+	if (err != 0)
+	{
+		fprintf(stderr,"Error starting thread in poolStart(): %s\n",strerror(err));
+		exit(EXIT_FAILURE);
+	}
+}
+
+void poolStop(passPool *p)
+{
+	pthread_mutex_lock(&p->lock);
+	p->stop = 1;
+	pthread_cond_signal(&p->wake);
+	pthread_mutex_unlock(&p->lock);
+	pthread_join(p->thread, NULL);
+	sugFree(p->ctx); p->ctx = NULL;
+	free(p->buf); p->buf = NULL;
+	free(p->len); p->len = NULL;
+}
+
+/**-------- FUNCTION: poolTake
+
+   copy up to 'count' ready passwords from the pool 'p' to 'out',
+   setting '*used' to the bytes copied. Returns the number copied -
+   fewer than asked for if the refill thread has not kept up.
+
+*/
+
+long long poolTake(passPool *p, long long count, char *out, size_t *used)
+{
+	size_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+	size_t ready = atomic_load_explicit(&p->tail, memory_order_acquire) - head;
+	size_t take = (size_t)count < ready ? (size_t)count : ready;
+	char *o = out;
+	for (size_t n = 0; n < take; n++)
+	{
+		size_t i = (head + n) % POOL_SIZE;
+		memcpy(o, p->buf + (i * p->slotLen), p->len[i]);
+		o += p->len[i];
+	}
+	atomic_store_explicit(&p->head, head + take, memory_order_release);
+	// wake the refill thread if this took the pool down to POOL_LOW
+	if (ready > POOL_LOW && ready - take <= POOL_LOW)
+	{
+		pthread_mutex_lock(&p->lock);
+		pthread_cond_signal(&p->wake);
+		pthread_mutex_unlock(&p->lock);
+	}
+	*used = (size_t)(o - out);
+	return (long long)take;
+}
+
+/**-------- FUNCTION: connReserve
+
+   make sure connection 'c' has room for 'len' more bytes of output -
+   moving any unsent output to the start of the buffer first
+
+*/
+
+void connReserve(serveConn *c, size_t len)
+{
+	if (c->outSent > 0)
+	{
+		memmove(c->out, c->out + c->outSent, c->outLen - c->outSent);
+		c->outLen -= c->outSent;
+		c->outSent = 0;
+	}
+	if (c->outCap - c->outLen >= len) return;
+	size_t cap = c->outCap ? c->outCap : 4096;
+	while (cap - c->outLen < len) cap *= 2;
+	char *out = realloc(c->out, cap);
+	if (out == NULL)
+	{
+		fprintf(stderr,"Error allocating memory in connReserve(): %s\n",strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	c->out = out;
+	c->outCap = cap;
+}
+
+/**-------- FUNCTION: connError
+
+   add the error 'msg' to the output for connection 'c' - as one line
+   starting 'ERROR: ' in place of the passwords asked for
+
+*/
+
+void connError(serveConn *c, const char *msg)
+{
+	size_t len = strlen(msg);
+	connReserve(c, len + 8);
+	memcpy(c->out + c->outLen, "ERROR: ", 7);
+	memcpy(c->out + c->outLen + 7, msg, len);
+	c->out[c->outLen + 7 + len] = '\n';
+	c->outLen += len + 8;
+}
+
+/**-------- FUNCTION: serveRequest
+
+   answer one request 'line' from connection 'c' by adding the
+   passwords asked for to its output. A request is a line of words
+   separated by spaces, all optional:
+
+	COUNT              - number of passwords (default 1)
+	words=N            - words in each password
+	require=LIST       - as '--require'
+	separator=C        - as '--separator'
+	capitalise         - as '--capitalise'
+	min-entropy=BITS   - as '--min-entropy'
+	max-len=N          - as '--max-len'
+
+   The reply is COUNT lines of one password each - or a single line
+   starting 'ERROR: ' if the request cannot be met, or the reply could
+   be more than SERVE_OUT_MAX bytes. Requests with no
+   settings are answered from the pool - others start from the
+   server's settings and change them as asked, using 'custom'.
+
+*/
+
+void serveRequest(serveThread *st, serveConn *c, char *line)
+{
+	long long count = 1;
+	int own = 0;
+	int nWords = st->ctx->wordsFloor;
+	passPolicy p = st->ctx->policy;
+	char msg[SUG_ERR_LEN];
+
+	char *save = NULL;
+	for (char *tok = strtok_r(line, " \t\r", &save); tok; tok = strtok_r(NULL, " \t\r", &save))
+	{
+		char *val = strchr(tok, '=');
+		if (val) *val++ = '\0';
+		if (isdigit((unsigned char)*tok)) count = strtoll(tok, NULL, 10);
+		else if (val && strcmp(tok, "words") == 0 && isdigit((unsigned char)*val)) { nWords = atoi(val); own = 1; }
+		else if (val && strcmp(tok, "require") == 0 && parseRequire(val, &p) == 0) own = 1;
+		else if (val && strcmp(tok, "separator") == 0 && strlen(val) == 1 && !isalpha((unsigned char)*val)) { p.separator = *val; own = 1; }
+		else if (!val && strcmp(tok, "capitalise") == 0) { p.capitalise = 1; own = 1; }
+		else if (val && strcmp(tok, "min-entropy") == 0 && isdigit((unsigned char)*val)) { p.minEntropy = atof(val); own = 1; }
+		else if (val && strcmp(tok, "max-len") == 0 && isdigit((unsigned char)*val)) { p.maxLen = atoi(val); own = 1; }
+		else
+		{
+			snprintf(msg, sizeof(msg), "invalid request '%s%s%s'", tok, val ? "=" : "", val ? val : "");
+			connError(c, msg);
+			return;
+		}
+	}
+	if (count < 1 || count > SERVE_MAX_COUNT)
+	{
+		snprintf(msg, sizeof(msg), "count must be 1 to %d", SERVE_MAX_COUNT);
+		connError(c, msg);
+		return;
+	}
+
+	sugContext *gen = st->ctx;
+	if (own)
+	{
+		// settings are changed in an order that can always succeed until
+		// the new policy is checked against the new number of words
+		passPolicy none;
+		memset(&none, 0, sizeof(none));
+		gen = st->custom;
+		if (sugSetPolicy(gen, &none) != 0 || sugSetWords(gen, nWords) != 0 || sugSetPolicy(gen, &p) != 0)
+		{
+			connError(c, sugError(gen));
+			return;
+		}
+	}
+	// one reply is never more than SERVE_OUT_MAX - so long passwords
+	// cannot get around the limit on output held for a client
+	if ((size_t)count * (sugMaxLength(gen) + 1) > SERVE_OUT_MAX)
+	{
+		snprintf(msg, sizeof(msg), "%lld passwords of up to %zu characters is more than %d bytes - ask for fewer",
+			count, sugMaxLength(gen), SERVE_OUT_MAX);
+		connError(c, msg);
+		return;
+	}
+	connReserve(c, (size_t)count * (sugMaxLength(gen) + 1));
+	size_t start = c->outLen, used = 0;
+	long long done = own ? 0 : poolTake(&st->pool, count, c->out + c->outLen, &used);
+	c->outLen += used;
+	// any not in the pool are made now
+	if (done < count)
+	{
+		if (sugGenerateBatch(gen, count - done, '\n', c->out + c->outLen, c->outCap - c->outLen, &used) < 0)
+		{
+			c->outLen = start;
+			connError(c, sugError(gen));
+			return;
+		}
+		c->outLen += used;
+	}
+}
+
+/**-------- FUNCTION: connRead
+
+   read what connection 'c' has sent and answer each whole request
+   line. Returns -1 if the connection failed and should be closed.
+
+*/
+
+int connRead(serveThread *st, serveConn *c)
+{
+	while (!c->closing && c->outLen - c->outSent < SERVE_OUT_MAX)
+	{
+		ssize_t got = recv(c->fd, c->in + c->inLen, SERVE_LINE_MAX - c->inLen, 0);
+		if (got < 0)
+		{
+			if (errno == EINTR) continue;
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		if (got == 0)
+		{
+			c->closing = 1;
+			break;
+		}
+		c->inLen += (size_t)got;
+
+		// answer each whole line - and keep any part line for next time
+		char *start = c->in, *end = c->in + c->inLen, *eol;
+		while ((eol = memchr(start, '\n', end - start)) != NULL)
+		{
+			*eol = '\0';
+			serveRequest(st, c, start);
+			start = eol + 1;
+		}
+		c->inLen = (size_t)(end - start);
+		memmove(c->in, start, c->inLen);
+		if (c->inLen == SERVE_LINE_MAX)
+		{
+			connError(c, "request line too long");
+			c->closing = 1;
+		}
+	}
+	return 0;
+}
+
+/**-------- FUNCTION: connFlush
+
+   send as much of the output waiting for connection 'c' as the socket
+   will take without blocking. Returns -1 if the connection failed.
+
+*/
+
+int connFlush(serveConn *c)
+{
+	while (c->outSent < c->outLen)
+	{
+		ssize_t done = send(c->fd, c->out + c->outSent, c->outLen - c->outSent, MSG_NOSIGNAL);
+		STAT_ADD(syscalls, 1);
+		if (done < 0)
+		{
+			if (errno == EINTR) continue;
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		STAT_ADD(bytesOut, done);
+		c->outSent += (size_t)done;
+	}
+	return 0;
+}
+
+/**-------- FUNCTION: connClose
+
+   close connection 'c' and free its memory
+
+*/
+
+void connClose(serveConn *c)
+{
+	close(c->fd);
+	free(c->out);
+	free(c);
+}
+
+/**-------- FUNCTION: serveAccept
+
+   accept every waiting connection on the listening socket and add
+   each to the epoll set 'ep'. Other server threads may have taken
+   them first - which is fine.
+
+*/
+
+void serveAccept(serveThread *st, int ep)
+{
+	for (;;)
+	{
+		int fd = accept4(st->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				fprintf(stderr,"Error accepting connection in serveAccept(): %s\n",strerror(errno));
+			return;
+		}
+		serveConn *c = xmalloc(sizeof(serveConn), "serveAccept");
+		memset(c, 0, sizeof(*c));
+		c->fd = fd;
+		c->events = EPOLLIN;
+		struct epoll_event ev = { .events = c->events, .data.ptr = c };
+		if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) != 0) connClose(c);
+	}
+}
+
+/**-------- FUNCTION: serveLoop
+
+   event loop of a server thread: waits with epoll for new connections
+   and for clients that have sent requests or can take more output.
+   Requests are only read from a client while its unsent output is
+   under SERVE_OUT_MAX, so a client that never reads cannot use up the
+   server's memory.
+
+*/
+
+void *serveLoop(void *arg)
+{
+	serveThread *st = arg;
+	int ep = epoll_create1(EPOLL_CLOEXEC);
+	// the listening socket is marked by a NULL pointer - and exclusive, so
+	// a new connection only wakes one of the server threads
+	struct epoll_event lev = { .events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL };
+	if (ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, st->listenFd, &lev) != 0)
+	{
+		fprintf(stderr,"Error setting up epoll in serveLoop(): %s\n",strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	struct epoll_event events[SERVE_EVENTS];
+	while (!serveStop)
+	{
+		int n = epoll_wait(ep, events, SERVE_EVENTS, 250);
+		for (int i = 0; i < n; i++)
+		{
+			serveConn *c = events[i].data.ptr;
+			if (c == NULL)
+			{
+				serveAccept(st, ep);
+				continue;
+			}
+			if (connRead(st, c) != 0 || connFlush(c) != 0 ||
+				(c->closing && c->outSent == c->outLen))
+			{
+				connClose(c);
+				continue;
+			}
+			// wait for requests while there is room for their output, and
+			// for the socket to take more while there is output waiting
+			size_t waiting = c->outLen - c->outSent;
+			uint32_t want = (!c->closing && waiting < SERVE_OUT_MAX ? EPOLLIN : 0) | (waiting ? EPOLLOUT : 0);
+			if (want != c->events)
+			{
+				struct epoll_event ev = { .events = want, .data.ptr = c };
+				c->events = want;
+				epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+			}
+		}
+	}
+	close(ep);
+	sugStatsMerge();
+	return NULL;
+}
+
+/**-------- FUNCTION: servePasswords
+
+   run as a daemon serving passwords made with context 'c' to clients
+   of the Unix socket 'path', with 'threads' server threads. Each has
+   its own epoll event loop, contexts, and pool of passwords made
+   ahead by a refill thread, so a typical request is answered with
+   one copy and one send(). Runs until SIGINT or SIGTERM, then removes
+   the socket.
+
+*/
+
+void servePasswords(sugContext *c, const char *path, int threads)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr,"ERROR: socket path '%s' is too long\n",path);
+		exit(EXIT_FAILURE);
+	}
+	strcpy(addr.sun_path, path);
+
+	// remove a socket left by an earlier run - but never any other file
+	struct stat sb;
+	if (lstat(path, &sb) == 0 && S_ISSOCK(sb.st_mode)) unlink(path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+	{
+		fprintf(stderr,"ERROR: unable to listen on socket '%s': %s\n",path,strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	signal(SIGINT, serveSignal);
+	signal(SIGTERM, serveSignal);
+	signal(SIGPIPE, SIG_IGN);
+
+	serveThread *st = xmalloc(sizeof(serveThread) * threads, "servePasswords");
+	for (int t = 0; t < threads; t++)
+	{
+		st[t].listenFd = fd;
+		st[t].ctx = sugClone(c);
+		st[t].custom = sugClone(c);
+		if (st[t].ctx == NULL || st[t].custom == NULL)
+		{
+			fprintf(stderr,"ERROR: unable to set up server in servePasswords(): %s\n",sugError(c));
+			exit(EXIT_FAILURE);
+		}
+		poolStart(&st[t].pool, c);
+		int err = pthread_create(&st[t].thread, NULL, serveLoop, &st[t]);
+		if (err != 0)
+		{
+			fprintf(stderr,"Error starting thread in servePasswords(): %s\n",strerror(err));
+			exit(EXIT_FAILURE);
+		}
+	}
+	fprintf(stderr,"Serving passwords on '%s' with %d thread(s) - stop with Ctrl-C\n",path,threads);
+
+	for (int t = 0; t < threads; t++)
+	{
+		pthread_join(st[t].thread, NULL);
+		poolStop(&st[t].pool);
+		sugFree(st[t].ctx);
+		sugFree(st[t].custom);
+	}
+	free(st); st = NULL;
+	close(fd);
+	unlink(path);
+}
+
+#else
+
+void servePasswords(sugContext *c, const char *path, int threads)
+{
+	fprintf(stderr,"ERROR: --serve is only available on Linux\n");
+	exit(EXIT_FAILURE);
+}
+
+#endif
+
+
+/*-----------------------*/
+/* BENCHMARKS            */
+/*-----------------------*/
+
+/* passwords made in each timed repeat of a benchmark */
+#define BENCH_PASSWORDS 100000
+/* timed repeats of each benchmark - percentiles are taken over these */
+#define BENCH_REPS 21
+/* timed repeats of the thread benchmarks - each outputs BENCH_THREAD_SCALE
+   times as many passwords */
+#define BENCH_THREAD_REPS 5
+#define BENCH_THREAD_SCALE 20
+
+static int cmpDouble(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**-------- FUNCTION: benchReport
+
+   output one benchmark result as a JSON object on stdout - and a one
+   line summary on stderr. 'nsPer' holds the ns per password of each of
+   the 'reps' timed repeats (it is sorted here), and 'bytes' is the
+   memory allocated during all of them.
+
+*/
+
+int benchFirst = 1;
+
+void benchReport(const char *group, const char *name, double *nsPer, int reps, unsigned long long bytes)
+{
+	qsort(nsPer, reps, sizeof(double), cmpDouble);
+	#define PCT(q) nsPer[(int)ceil((q) * reps) - 1]
+	double p50 = PCT(0.50);
+	printf("%s\n    {\"group\": \"%s\", \"name\": \"%s\", \"reps\": %d, "
+		"\"ns_per_password\": {\"min\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f}, "
+		"\"passwords_per_sec\": %.0f, \"bytes_allocated\": %llu}",
+		benchFirst ? "" : ",", group, name, reps,
+		nsPer[0], p50, PCT(0.90), PCT(0.99), nsPer[reps-1], 1e9 / p50, bytes);
+	#undef PCT
+	benchFirst = 0;
+	fprintf(stderr,"%-8s %-24s %9.2f ns/password  %12.0f passwords/sec  %10llu bytes allocated\n",
+		group, name, p50, 1e9 / p50, bytes);
+}
+
+/**-------- FUNCTION: benchGenerate
+
+   time making BENCH_PASSWORDS passwords, BENCH_REPS times, with the
+   context 'c' - so its engine, kernel, dictionary and policy - with
+   the spaced form too if 'spaced' is set. Passwords are made into one
+   reused arena, so this times generation alone, without any output.
+
+*/
+
+void benchGenerate(const char *group, const char *name, sugContext *c, int spaced)
+{
+	double nsPer[BENCH_REPS];
+	size_t need = (2 * sugMaxLength(c)) + policyTokens(&c->policy, c->nWords) + 2;
+	unsigned long long before = sugAllocatedBytes();
+	char *mem = xmalloc(need, "benchGenerate");
+	passArena a;
+	arenaInit(&a, mem, need);
+
+	for (int r = 0; r < BENCH_REPS; r++)
+	{
+		uint64_t start = nowNs();
+		for (int i = 0; i < BENCH_PASSWORDS; i++)
+		{
+			char *plain, *spc;
+			arenaReset(&a);
+			arenaPassword(&a, c, &plain, spaced ? &spc : NULL);
+		}
+		nsPer[r] = (double)(nowNs() - start) / BENCH_PASSWORDS;
+	}
+	free(mem); mem = NULL;
+	benchReport(group, name, nsPer, BENCH_REPS, sugAllocatedBytes() - before);
+}
+
+/**-------- FUNCTION: benchBulk
+
+   time the whole bulk output path - bulkPasswords(), or with more than
+   one thread bulkPasswordsThreaded() - writing to the null device, so
+   the writes are included but not the cost of storing the output
+
+*/
+
+void benchBulk(const char *name, int threads)
+{
+	double nsPer[BENCH_THREAD_REPS];
+	long long count = (long long)BENCH_PASSWORDS * BENCH_THREAD_SCALE;
+	int fd = open("/dev/null", O_WRONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr,"ERROR: unable to open /dev/null: %s\n",strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	unsigned long long before = sugAllocatedBytes();
+	for (int r = 0; r < BENCH_THREAD_REPS; r++)
+	{
+		uint64_t start = nowNs();
+		if (threads > 1) bulkPasswordsThreaded(ctx, count, threads, fd);
+		else bulkPasswords(ctx, count, fd);
+		nsPer[r] = (double)(nowNs() - start) / count;
+	}
+	close(fd);
+	benchReport("bulk", name, nsPer, BENCH_THREAD_REPS, sugAllocatedBytes() - before);
+}
+
+/**-------- FUNCTION: benchDict
+
+   make a dictionary 'd' of 'n' random lower case words of 3 to 8
+   letters - standing in for large word lists of varied length words
+
+*/
+
+void benchDict(wordDict *d, uint32_t n, randEngine *eng)
+{
+	char err[SUG_ERR_LEN];
+	if (rngSeed(eng, err) != 0)
+	{
+		fprintf(stderr,"ERROR: %s\n",err);
+		exit(EXIT_FAILURE);
+	}
+	if (dictAlloc(d, n, (size_t)n * 8) != 0)
+	{
+		fprintf(stderr,"Error allocating memory in benchDict(): %s\n",strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	for (uint32_t i = 0; i < n; i++)
+	{
+		char w[8];
+		uint32_t len = 3 + rngUniform(eng, 6);
+		for (uint32_t c = 0; c < len; c++) w[c] = 'a' + rngUniform(eng, 26);
+		dictAdd(d, w, len);
+	}
+}
+
+/**-------- FUNCTION: benchContext
+
+   a copy of the program's context for a benchmark to change - exits
+   if it cannot be made
+
+*/
+
+sugContext *benchContext()
+{
+	sugContext *c = sugClone(ctx);
+	if (c == NULL)
+	{
+		fprintf(stderr,"ERROR: unable to set up benchmark: %s\n",sugError(ctx));
+		exit(EXIT_FAILURE);
+	}
+	return c;
+}
+
+/**-------- FUNCTION: benchStart
+
+   time starting this program to output one password with '-q' - the
+   whole run, from posix_spawn() until it has exited - BENCH_START_REPS
+   times. Output goes to the null device. Each run makes one password,
+   so its ns per password is the time the run took.
+
+*/
+
+/* timed runs of the startup benchmark */
+#define BENCH_START_REPS 101
+/* the program to run - the one running now */
+char *progPath = NULL;
+
+void benchStart()
+{
+	double nsPer[BENCH_START_REPS];
+	char *args[] = { progPath, "-q", NULL };
+	posix_spawn_file_actions_t fa;
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+	for (int r = 0; r < BENCH_START_REPS; r++)
+	{
+		pid_t pid;
+		int status;
+		uint64_t start = nowNs();
+		int err = posix_spawnp(&pid, progPath, &fa, NULL, args, environ);
+		if (err != 0)
+		{
+			fprintf(stderr,"ERROR: unable to run '%s' for --bench-startup: %s\n",progPath,strerror(err));
+			exit(EXIT_FAILURE);
+		}
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			fprintf(stderr,"ERROR: '%s -q' failed in --bench-startup\n",progPath);
+			exit(EXIT_FAILURE);
+		}
+		nsPer[r] = (double)(nowNs() - start);
+	}
+	posix_spawn_file_actions_destroy(&fa);
+#ifdef SUGPASS_HEADLESS
+	benchReport("startup", "headless -q", nsPer, BENCH_START_REPS, 0);
+#else
+	benchReport("startup", "-q", nsPer, BENCH_START_REPS, 0);
+#endif
+}
+
+/**-------- FUNCTION: runBenchmarks
+
+   run every benchmark and output the results as JSON on stdout, with
+   a readable summary on stderr. Covers each random engine, each
+   password assembly kernel the CPU supports, the fixed stride and
+   offset index word table layouts, with and without the spaced form,
+   the markov mode, with a policy, dictionary sizes, bulk output with 1
+   thread up to the number of CPUs, and starting the program. Each is
+   run with its own copy of the program's context, changed as the
+   benchmark needs.
+
+*/
+
+void runBenchmarks()
+{
+	passPolicy none;
+	memset(&none, 0, sizeof(none));
+	passPolicy strict = none;
+	strict.requireDigit = strict.requireUpper = strict.requireSymbol = 1;
+	strict.separator = '-';
+	sugContext *c = benchContext();
+	sugSetPolicy(c, &none);
+	sugSetMode(c, "words");
+	wordDict *dict = c->dict;
+
+	printf("{\n  \"program\": \"sugpass\",\n  \"version\": \"%s\",\n  \"words_per_password\": %d,\n"
+		"  \"passwords_per_rep\": %d,\n  \"results\": [", version, sugWords(c), BENCH_PASSWORDS);
+
+	// random engines - with the default kernel and dictionary
+	for (size_t i = 0; i < engineCount; i++)
+	{
+		sugContext *e = benchContext();
+		sugSetPolicy(e, &none);
+		sugSetEngine(e, engineTable[i].name);
+		benchGenerate("engine", engineTable[i].name, e, 0);
+		sugFree(e);
+	}
+
+	// password assembly kernels - each supported by this CPU
+	for (size_t i = 0; i < kernelCount; i++)
+	{
+		if (!kernelSupported(kernelTable[i].name)) continue;
+		sugSetKernel(c, kernelTable[i].name);
+		char name[64];
+		snprintf(name, sizeof(name), "%s", kernelTable[i].name);
+		benchGenerate("kernel", name, c, 0);
+		snprintf(name, sizeof(name), "%s+spaced", kernelTable[i].name);
+		benchGenerate("kernel", name, c, 1);
+	}
+	sugSetKernel(c, kernelName);
+
+	// word table layouts - the same words with an offset index instead
+	wordDict indexed;
+	if (dictAlloc(&indexed, dict->count, (size_t)dict->count * dict->maxLen) != 0)
+	{
+		fprintf(stderr,"Error allocating memory in runBenchmarks(): %s\n",strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	for (uint32_t i = 0; i < dict->count; i++)
+	{
+		if (dict->wordLen) dictAdd(&indexed, dict->data + ((size_t)i * dict->stride), dict->wordLen);
+		else dictAdd(&indexed, dict->data + dict->offset[i], dict->offset[i+1] - dict->offset[i]);
+	}
+	indexed.wordLen = 0;
+	benchGenerate("layout", dict->wordLen ? "fixed-stride" : "offset-index", c, 0);
+	// the benchmark dictionaries are swapped in for the context's own
+	// one, which is put back before the context is freed
+	c->dict = &indexed;
+	benchGenerate("layout", "offset-index", c, 0);
+	benchGenerate("layout", "offset-index+spaced", c, 1);
+	c->dict = dict;
+
+	// pronounceable passwords from the markov chain - the same number of
+	// syllables as there are words
+	sugContext *m = benchContext();
+	sugSetPolicy(m, &none);
+	sugSetMode(m, "markov");
+	benchGenerate("mode", "markov", m, 0);
+	benchGenerate("mode", "markov+spaced", m, 1);
+	sugFree(m);
+
+	// policy applied as passwords are made
+	sugSetPolicy(c, &strict);
+	benchGenerate("policy", "digit,upper,symbol,sep", c, 1);
+	sugSetPolicy(c, &none);
+
+	// dictionary sizes
+	uint32_t sizes[] = { 10000, 100000, 1000000 };
+	for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+	{
+		wordDict big;
+		char name[64];
+		benchDict(&big, sizes[i], &c->eng);
+		snprintf(name, sizeof(name), "%u-words", sizes[i]);
+		c->dict = &big;
+		benchGenerate("dict", name, c, 0);
+		c->dict = dict;
+		dictRelease(&big);
+	}
+	sugFree(c);
+
+	// bulk output - single thread, then threads up to the CPU count
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1) cpus = 1;
+	benchBulk("1-thread", 1);
+	for (long t = 2; t <= cpus && t <= MAX_THREADS; t *= 2)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "%ld-threads", t);
+		benchBulk(name, (int)t);
+	}
+	benchStart();
+	printf("\n  ]\n}\n");
+	dictRelease(&indexed);
+}
+
+/**-------- FUNCTION: runStartupBenchmark
+
+   run just the startup benchmark for '--bench-startup' - with JSON
+   output in the same form as runBenchmarks()
+
+*/
+
+void runStartupBenchmark()
+{
+	printf("{\n  \"program\": \"sugpass\",\n  \"version\": \"%s\",\n  \"words_per_password\": %d,\n"
+		"  \"passwords_per_rep\": 1,\n  \"results\": [", version, sugWords(ctx));
+	benchStart();
+	printf("\n  ]\n}\n");
+}
+
+/*-----------------------*/
+/* QUALITY TESTS         */
+/*-----------------------*/
+
+/*
+	'--quality DRAWS' checks that word selection is as random as it
+	should be: DRAWS words are chosen with selectWords() - split over
+	the threads of '-j' (default every CPU) - and the counts compared
+	with what a perfectly uniform choice would give. Each thread keeps
+	its own counters in memory of its own, so no cache lines are shared
+	while it runs, and they are only added up at the end. The tests:
+
+	   chi-square      - how often each word was chosen, over all the
+	                     draws and at each position in the password
+	   serial          - correlation of each word with the one after it
+	   collisions      - blocks of passwords are made and the number
+	                     that repeat one already in the block (by their
+	                     first two words) counted - Knuth's collision test
+
+	Each gives a p-value, and a test fails if it is below QUALITY_ALPHA
+	- or for chi-square, above 1 - QUALITY_ALPHA, as counts too even
+	are as suspect as counts too uneven.
+*/
+
+/* p-value below which a test fails - a good generator fails one of
+   the tests about once in 1000 runs */
+#define QUALITY_ALPHA 0.0001
+/* collisions expected in each block of the collision test */
+#define QUALITY_COLLISIONS 64
+/* fewest keys the collision test needs to be meaningful - and most, so
+   its bitmap of keys seen stays small (2 MB) */
+#define QUALITY_MIN_KEYS 4096
+#define QUALITY_MAX_KEYS (1u << 24)
+
+/* the counters of one thread - on cache lines of their own */
+typedef struct {
+	_Alignas(64) sugContext *ctx;   // the program's context - cloned by the thread
+	pthread_t thread;
+	uint64_t first;                 // number of the thread's first password
+	uint64_t passwords;             // passwords to make
+	uint64_t *hist;                 // times each word was drawn - 'n' rows, one per position
+	uint64_t sumX;                  // sum of the word numbers drawn
+	unsigned __int128 sumXX;        // ... of their squares
+	unsigned __int128 sumXY;        // ... of each times the one before it
+	uint32_t firstX, lastX;         // first and last word numbers drawn
+	uint64_t keys;                  // collision test: keys - 'n' == 1 ? K : K * K
+	uint64_t block;                 // ... keys in each block
+	uint64_t blocks;                // ... blocks made
+	uint64_t collisions;            // ... collisions in them
+} qualityPart;
+
+/**-------- FUNCTION: qualityWorker
+
+   thread for runQuality(): make the passwords of its 'qualityPart' -
+   with '--seed' from its own part of the seeded run - and count the
+   words drawn
+
+*/
+
+void *qualityWorker(void *arg)
+{
+	qualityPart *q = arg;
+	sugContext *c = sugClone(q->ctx);
+	if (c == NULL || rngSeed(&c->eng, c->error) != 0)
+	{
+		fprintf(stderr,"ERROR: unable to set up thread in qualityWorker(): %s\n",sugError(c ? c : q->ctx));
+		exit(EXIT_FAILURE);
+	}
+	int n = sugWords(c);
+	uint32_t count = sugDictSize(c);
+	// counters are allocated and cleared by the thread using them
+	uint32_t *idx = xmalloc(sizeof(uint32_t) * n, "qualityWorker");
+	uint64_t *hist = xmalloc(sizeof(uint64_t) * n * count, "qualityWorker");
+	memset(hist, 0, sizeof(uint64_t) * n * count);
+	uint64_t *seen = NULL, *blockKeys = NULL, used = 0, hits = 0;
+	if (q->keys)
+	{
+		seen = xmalloc((q->keys + 63) / 64 * sizeof(uint64_t), "qualityWorker");
+		memset(seen, 0, (q->keys + 63) / 64 * sizeof(uint64_t));
+		blockKeys = xmalloc(sizeof(uint64_t) * q->block, "qualityWorker");
+	}
+	uint64_t sumX = 0;
+	unsigned __int128 sumXX = 0, sumXY = 0;
+	uint32_t prev = 0;
+
+	sugSeek(c, q->first);
+	for (uint64_t p = 0; p < q->passwords; p++)
+	{
+		rngStartPassword(&c->eng);
+		selectWords(c, idx, n);
+		if (p == 0) q->firstX = idx[0];
+		for (int i = 0; i < n; i++)
+		{
+			uint32_t x = idx[i];
+			hist[((size_t)i * count) + x]++;
+			sumX += x;
+			sumXX += (uint64_t)x * x;
+			// the first draw has no word before it - and adds 0
+			sumXY += (uint64_t)prev * x;
+			prev = x;
+		}
+		if (seen)
+		{
+			uint64_t key = n == 1 || q->keys == count ? idx[0] : ((uint64_t)idx[0] * count) + idx[1];
+			uint64_t bit = 1ULL << (key & 63);
+			if (seen[key >> 6] & bit) hits++;
+			seen[key >> 6] |= bit;
+			blockKeys[used++] = key;
+			// a full block - count its collisions and start the next
+			if (used == q->block)
+			{
+				for (uint64_t k = 0; k < used; k++) seen[blockKeys[k] >> 6] = 0;
+				q->blocks++;
+				q->collisions += hits;
+				used = hits = 0;
+			}
+		}
+	}
+	q->lastX = prev;
+	q->hist = hist;
+	q->sumX = sumX;
+	q->sumXX = sumXX;
+	q->sumXY = sumXY;
+	free(seen); seen = NULL;
+	free(blockKeys); blockKeys = NULL;
+	free(idx); idx = NULL;
+	sugFree(c);
+	return NULL;
+}
+
+/**-------- FUNCTION: chiSquareP / normalP
+
+   chiSquareP() is the chance of a chi-square value of 'x' or more with
+   'df' degrees of freedom - by the Wilson-Hilferty approximation,
+   close for the large 'df' of a word list. normalP() is the chance of
+   a standard normal value at least 'z' from zero (either side).
+
+*/
+
+double chiSquareP(double x, double df)
+{
+	double v = 2.0 / (9.0 * df);
+	double z = (cbrt(x / df) - (1.0 - v)) / sqrt(v);
+	return 0.5 * erfc(z / sqrt(2.0));
+}
+
+double normalP(double z)
+{
+	return erfc(fabs(z) / sqrt(2.0));
+}
+
+/**-------- FUNCTION: qualityResult
+
+   output the result of one test - its statistic and p-value - and
+   return 1 if it failed. With 'bothTails' a p-value near 1 fails too.
+
+*/
+
+int qualityResult(const char *name, const char *stat, double value, double p, int bothTails)
+{
+	int failed = p < QUALITY_ALPHA || (bothTails && p > 1.0 - QUALITY_ALPHA);
+	printf("  %-26s %-6s %14.6g   p = %-10.6f %s\n", name, stat, value, p, failed ? "FAIL" : "pass");
+	return failed;
+}
+
+/**-------- FUNCTION: runQuality
+
+   run the '--quality' tests on 'draws' words chosen with the settings
+   of context 'c' using 'threads' threads, and output the results.
+   Returns EXIT_FAILURE if any test failed - so 'make quality' does too.
+
+*/
+
+int runQuality(sugContext *c, long long draws, int threads)
+{
+	int n = sugWords(c);
+	uint32_t count = sugDictSize(c);
+	uint64_t passwords = ((uint64_t)draws + n - 1) / n;
+	uint64_t total = passwords * n;
+	if (count < 2)
+	{
+		fprintf(stderr,"ERROR: --quality needs a word list of at least two words\n");
+		exit(EXIT_FAILURE);
+	}
+	// chi-square needs each word expected at least 5 times at each position
+	if (passwords < 5ULL * count)
+	{
+		fprintf(stderr,"ERROR: --quality needs at least %llu draws to test %u words\n",5ULL * count * n,count);
+		exit(EXIT_FAILURE);
+	}
+
+	// the collision test's keys are the first two words - or if there
+	// would be too many, or only one word per password, the first word
+	uint64_t keys = (n > 1 && (uint64_t)count * count <= QUALITY_MAX_KEYS) ? (uint64_t)count * count : count;
+	if (keys < QUALITY_MIN_KEYS || keys > QUALITY_MAX_KEYS) keys = 0;
+	// block size that gives QUALITY_COLLISIONS expected collisions: m^2 / 2N
+	uint64_t block = keys ? (uint64_t)ceil(sqrt(2.0 * QUALITY_COLLISIONS * (double)keys)) : 0;
+
+	qualityPart *part = xmalloc(sizeof(qualityPart) * threads, "runQuality");
+	uint64_t start = sugTell(c), t0 = nowNs();
+	for (int t = 0; t < threads; t++)
+	{
+		memset(&part[t], 0, sizeof(qualityPart));
+		part[t].ctx = c;
+		part[t].first = start + (passwords * t / threads);
+		part[t].passwords = (passwords * (t + 1) / threads) - (passwords * t / threads);
+		part[t].keys = keys;
+		part[t].block = block;
+		int err = pthread_create(&part[t].thread, NULL, qualityWorker, &part[t]);
+		if (err != 0)
+		{
+			fprintf(stderr,"Error starting thread in runQuality(): %s\n",strerror(err));
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (int t = 0; t < threads; t++) pthread_join(part[t].thread, NULL);
+	double secs = (nowNs() - t0) / 1e9;
+
+	// add up the threads' counters - into the first thread's histogram
+	uint64_t *hist = part[0].hist, sumX = 0, pairs = 0, sumA = 0, sumB = 0, blocks = 0, collisions = 0;
+	unsigned __int128 sumXX = 0, sumXY = 0;
+	for (int t = 0; t < threads; t++)
+	{
+		qualityPart *q = &part[t];
+		if (t > 0) for (size_t i = 0; i < (size_t)n * count; i++) hist[i] += q->hist[i];
+		sumX += q->sumX;
+		sumXX += q->sumXX;
+		sumXY += q->sumXY;
+		if (q->passwords == 0) continue;
+		// each thread's draws are a sequence of their own
+		pairs += (q->passwords * n) - 1;
+		sumA += q->sumX - q->lastX;
+		sumB += q->sumX - q->firstX;
+		blocks += q->blocks;
+		collisions += q->collisions;
+	}
+
+	printf("sugpass quality tests:\n");
+	printf("  draws                      %llu  (%llu passwords of %d words)\n",
+		(unsigned long long)total, (unsigned long long)passwords, n);
+	printf("  words                      %u\n", count);
+	printf("  random engine              %s%s\n", sugEngineName(c), seed ? " (seeded)" : "");
+	printf("  threads                    %d\n", threads);
+	printf("  elapsed time               %.3f s  (%.0f draws per second)\n\n", secs, secs > 0 ? total / secs : 0.0);
+
+	int failed = 0;
+	// chi-square of the counts of each word - over every position
+	// together, then at each position on its own
+	double all = 0, expect = (double)total / count;
+	for (uint32_t w = 0; w < count; w++)
+	{
+		uint64_t o = 0;
+		for (int i = 0; i < n; i++) o += hist[((size_t)i * count) + w];
+		double d = o - expect;
+		all += d * d / expect;
+	}
+	failed |= qualityResult("chi-square: all words", "x2", all, chiSquareP(all, count - 1), 1);
+	if (n > 1)
+	{
+		double perPos = (double)passwords / count;
+		for (int i = 0; i < n; i++)
+		{
+			double x2 = 0;
+			for (uint32_t w = 0; w < count; w++)
+			{
+				double d = hist[((size_t)i * count) + w] - perPos;
+				x2 += d * d / perPos;
+			}
+			char name[32];
+			snprintf(name, sizeof(name), "chi-square: position %d", i + 1);
+			failed |= qualityResult(name, "x2", x2, chiSquareP(x2, count - 1), 1);
+		}
+	}
+
+	// lag 1 serial correlation - near zero, by about 1/sqrt(pairs)
+	long double cov = ((long double)pairs * (long double)sumXY) - ((long double)sumA * (long double)sumB);
+	long double var = ((long double)total * (long double)sumXX) - ((long double)sumX * (long double)sumX);
+	double r = var > 0 ? (double)(cov / var * total * total / pairs / pairs) : 0.0;
+	double z = r * sqrt((double)pairs);
+	failed |= qualityResult("serial correlation", "r", r, normalP(z), 0);
+
+	// collisions - expected per block is m - N + N(1 - 1/N)^m, spread
+	// about as a Poisson count
+	if (blocks > 0)
+	{
+		double m = block, N = keys;
+		double perBlock = m - N * -expm1(m * log1p(-1.0 / N));
+		double want = perBlock * blocks;
+		double zc = (collisions - want) / sqrt(want);
+		char name[40];
+		snprintf(name, sizeof(name), "collisions (%s)", keys == count ? "first word" : "two words");
+		failed |= qualityResult(name, "z", zc, normalP(zc), 0);
+		printf("  %-26s %llu in %llu blocks of %llu - %.0f expected\n", "",
+			(unsigned long long)collisions, (unsigned long long)blocks, (unsigned long long)block, want);
+	}
+	else
+	{
+		printf("  %-26s skipped - %s\n", "collisions", keys ? "too few draws" : "too few or too many words");
+	}
+
+	printf("\nRESULT: %s\n", failed ? "FAIL" : "PASS");
+	for (int t = 0; t < threads; t++) free(part[t].hist);
+	free(part); part = NULL;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+/**-------------------------------*/
+/* MAIN - Program starts here    */
+/*-------------------------------*/
+
+int main(int argc, char **argv)
+{
+	// get any command line arguments provided by the user
+	getCLIArgs(argc,argv);
+	// this program - run again by the startup benchmark
+#if defined(__linux__)
+	progPath = "/proc/self/exe";
+#else
+	progPath = argv[0];
+#endif
+	// only what the options given need is set up - so a run of '-q' starts fast
+	if (stats) { atexit(exitCleanup); startNs = nowNs(); startCycles = cycleCount(); sugStatsEnable(1); }
+
+	// if debug - then print out size of our word array
+	if (debug) { printf("\tWord array size is: %d\n", wordArraySize); }
+
+	// set up the password generator: built in words, ChaCha20 engine and
+	// the fastest kernel - the engine is seeded when first used
+	ctx = sugCreate();
+	if (ctx == NULL) {
+		fprintf(stderr,"ERROR: unable to set up password generator\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// convert a word list to binary if requested with '--compile-wordlist'
+	if (compileIn) {
+		if (sugCompileWordList(ctx, compileIn, compileOut) != 0) {
+			fprintf(stderr,"ERROR: %s\n",sugError(ctx));
+			exit(EXIT_FAILURE);
+		}
+		// load what was written - which also checks it
+		if (sugLoadWordList(ctx, compileOut) != 0) {
+			fprintf(stderr,"ERROR: %s\n",sugError(ctx));
+			exit(EXIT_FAILURE);
+		}
+		printf("Wrote %u words (%.2f bits each) to binary word list '%s'\n",
+			sugDictSize(ctx),log2(sugDictSize(ctx)),compileOut);
+		sugFree(ctx); ctx = NULL;
+		return EXIT_SUCCESS;
+	}
+
+	// convert a password or hash list if requested with '--compile-blocklist'
+	if (compileBlockIn) {
+		long long n = sugCompileBlocklist(ctx, compileBlockIn, compileBlockOut);
+		// load what was written - which also checks it
+		if (n < 0 || sugLoadBlocklist(ctx, compileBlockOut) != 0) {
+			fprintf(stderr,"ERROR: %s\n",sugError(ctx));
+			exit(EXIT_FAILURE);
+		}
+		printf("Wrote %lld password hashes to blocklist '%s'\n",n,compileBlockOut);
+		sugFree(ctx); ctx = NULL;
+		return EXIT_SUCCESS;
+	}
+
+	// apply the options given: the word list file from '-f' (otherwise the
+	// built in three letter words are kept) less any '--exclude-words',
+	// words per password, policy, kernel, random engine and blocklist -
+	// each exits with the reason if it fails. With a minimum entropy
+	// and no '-w' the fewest words that give it are used. The kernel and
+	// engine are only changed if '--kernel' or '-r' were given
+	if ((wordFile && sugLoadWordList(ctx, wordFile) != 0) ||
+		(excludeFile && sugExcludeWords(ctx, excludeFile) != 0) ||
+		sugSetWords(ctx, (policy.minEntropy > 0 && !wordsGiven) ? 1 : wordsRequired) != 0 ||
+		sugSetPolicy(ctx, &policy) != 0 ||
+		(kernelName && sugSetKernel(ctx, kernelName) != 0) ||
+		(engineName && sugSetEngine(ctx, engineName) != 0) ||
+		sugSetFormat(ctx, formatName) != 0 ||
+		(seed && sugSetSeed(ctx, seed) != 0) ||
+		(blockFile && sugLoadBlocklist(ctx, blockFile) != 0)) {
+		fprintf(stderr,"ERROR: %s\n",sugError(ctx));
+		exit(EXIT_FAILURE);
+	}
+	// with '--mode' and no '-w' or '--min-entropy' passwords are made at
+	// least as strong as the words would have been
+	if (modeName) {
+		if (!wordsGiven && policy.minEntropy == 0) policy.minEntropy = sugEntropy(ctx);
+		if (sugSetMode(ctx, modeName) != 0 || sugSetPolicy(ctx, &policy) != 0) {
+			fprintf(stderr,"ERROR: %s\n",sugError(ctx));
+			exit(EXIT_FAILURE);
+		}
+	}
+	wordsRequired = sugWords(ctx);
+	if (debug) { printf("\tPolicy gives %d words with %.2f bits of entropy\n", wordsRequired, sugEntropy(ctx)); }
+	if (debug) { printf("\tPassword assembly kernel is: %s\n", sugKernelName(ctx)); }
+	if (debug) { printf("\tDictionary has %u words of up to %u characters\n", sugDictSize(ctx), ctx->dict->maxLen); }
+	if (debug) { printf("\tRandom engine is: %s\n", sugEngineName(ctx)); }
+	if (debug && ctx->markov) { printf("\tMarkov chain has %u letter pairs\n", ctx->markov->pairs); }
+
+	// a shard is a part of a seeded '-n' run - a server would repeat the
+	// same seeded passwords on every thread
+	if (shardCount && (!seed || bulkCount < 1)) {
+		fprintf(stderr,"ERROR: --shard needs both --seed and -n\n");
+		exit(EXIT_FAILURE);
+	}
+	// each shard could only drop repeats of its own passwords - so the
+	// shards together would no longer be unique
+	if (shardCount && unique) {
+		fprintf(stderr,"ERROR: --shard cannot be used with --unique\n");
+		exit(EXIT_FAILURE);
+	}
+	if (seed && servePath) {
+		fprintf(stderr,"ERROR: --seed cannot be used with --serve\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// records of '--format' are only made by '-n' and '-q'
+	recordEnd = ctx->format == FORMAT_NUL ? '\0' : '\n';
+	if (formatName && bulkCount < 1 && !quick) {
+		fprintf(stderr,"ERROR: --format can only be used with -n or -q\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// with '--hash' each password of '-n' or '-q' is output with its hash -
+	// and as hashing takes far longer than making the passwords, bulk
+	// output uses every CPU unless told otherwise with '-j'
+	if (hashName || hashRounds) {
+		if ((bulkCount < 1 && !quick) || servePath || bench || encode || decode) {
+			fprintf(stderr,"ERROR: --hash can only be used with -n or -q\n");
+			exit(EXIT_FAILURE);
+		}
+		if (ctx->format != FORMAT_RAW) {
+			fprintf(stderr,"ERROR: --hash can only be used with --format raw\n");
+			exit(EXIT_FAILURE);
+		}
+		if (sugSetHash(ctx, hashName ? hashName : "sha512-crypt", hashRounds) != 0) {
+			fprintf(stderr,"ERROR: %s\n",sugError(ctx));
+			exit(EXIT_FAILURE);
+		}
+		hashing = sugHashLength(ctx) > 0;
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (hashing && !threadsGiven && cpus > 1) numThreads = cpus < MAX_THREADS ? (int)cpus : MAX_THREADS;
+		if (debug) fprintf(stderr,"NB: passwords are hashed with '%s' on %d threads\n",hashName ? hashName : "sha512-crypt",numThreads);
+	}
+
+	// if '--encode' or '--decode' was requested convert the values and exit
+	if (encode || decode){
+		if (encode && decode) {
+			fprintf(stderr,"ERROR: please choose one of --encode or --decode\n");
+			exit(EXIT_FAILURE);
+		}
+		if (ctx->markov) {
+			fprintf(stderr,"ERROR: --encode and --decode use whole words - they cannot be used with --mode markov\n");
+			exit(EXIT_FAILURE);
+		}
+		return codeValues(ctx, decode, codeArgs, codeArgCount);
+	}
+
+	// if a daemon was requested with '--serve' run it until stopped
+	if (servePath){
+		servePasswords(ctx, servePath, numThreads);
+		return EXIT_SUCCESS;
+	}
+
+	// if benchmarks were requested with '--bench' run them and exit
+	if (bench){
+		runBenchmarks();
+		return EXIT_SUCCESS;
+	}
+
+	// if startup was to be timed with '--bench-startup' do so and exit
+	if (benchStartup){
+		runStartupBenchmark();
+		return EXIT_SUCCESS;
+	}
+
+	// if the '--quality' tests were requested run them - on every CPU
+	// unless told otherwise with '-j' - and exit with their result
+	if (qualityDraws){
+		if (ctx->markov) {
+			fprintf(stderr,"ERROR: --quality tests the choice of words - it cannot be used with --mode markov\n");
+			exit(EXIT_FAILURE);
+		}
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (!threadsGiven && cpus > 1) numThreads = cpus < MAX_THREADS ? (int)cpus : MAX_THREADS;
+		return runQuality(ctx, qualityDraws, numThreads);
+	}
+
+	// if bulk output was requested via command line option '-n' then
+	// output that many password suggestions and exit.
+	if (bulkCount > 0){
+		if (debug) fprintf(stderr,"NB: Bulk output of %lld passwords requested with '-n' option\n",bulkCount);
+		// with '--shard I/N' output just passwords (I-1)*n/N up to I*n/N of the
+		// run - spares for '--unique' come from past its end
+		if (seed) {
+			long long total = bulkCount;
+			if (shardCount) {
+				long long from = shardStart(total, shardIndex - 1, shardCount);
+				long long to = shardStart(total, shardIndex, shardCount);
+				sugSeek(ctx, (uint64_t)from);
+				bulkCount = to - from;
+				if (debug) fprintf(stderr,"NB: shard %lld/%lld is passwords %lld to %lld\n",shardIndex,shardCount,from,to - 1);
+				if (bulkCount == 0) return EXIT_SUCCESS;
+			}
+			spareStart = (uint64_t)total;
+		}
+		// the '--format' header goes once at the top of the whole run
+		outputInit(STDOUT_FILENO);
+		if (shardIndex <= 1) writeAll(STDOUT_FILENO, sugFormatHeader(ctx), strlen(sugFormatHeader(ctx)));
+		uniqueSet outSet;
+		if (unique) {
+			if (log2((double)bulkCount) > sugEntropy(ctx)) {
+				fprintf(stderr,"ERROR: only about %.0f different passwords can be made - use more words with '-w'\n",
+					pow(2, sugEntropy(ctx)));
+				exit(EXIT_FAILURE);
+			}
+			// too many passwords to keep track of in memory - use temporary files
+			if (uniqueSetBytes(bulkCount) > uniqueMem) {
+				bulkPasswordsSpill(ctx, bulkCount, STDOUT_FILENO, uniqueMem);
+				return EXIT_SUCCESS;
+			}
+			uniqueInit(&outSet, bulkCount);
+			seen = &outSet;
+		}
+		if (numThreads > 1) {
+			bulkPasswordsThreaded(ctx, bulkCount, numThreads, STDOUT_FILENO);
+		} else {
+			bulkPasswords(ctx, bulkCount, STDOUT_FILENO);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// if quick output was requested via command line option '-q' then
+	// output a password suggestion and exist. Ignore other options
+	// except debug, and password suggestion length
+	if (quick){
+		if (debug) printf("NB: Quick password requested with '-q' option\n");
+		outputInit(STDOUT_FILENO);
+		writeAll(STDOUT_FILENO, sugFormatHeader(ctx), strlen(sugFormatHeader(ctx)));
+		bulkPasswords(ctx, 1, STDOUT_FILENO);
+		return EXIT_SUCCESS;
+	}
+
+	// get the password suggestions first - one arena holds them all,
+	// plain and with spaces
+	size_t arenaSize = (size_t)numPassSuggestions *
+		((2 * sugMaxLength(ctx)) + policyTokens(&policy, wordsRequired) + 2);
+	char *arenaMem = xmalloc(arenaSize, "main");
+	char **plainPass = xmalloc(sizeof(char *) * numPassSuggestions, "main");
+	char **spacedPass = xmalloc(sizeof(char *) * numPassSuggestions, "main");
+	passArena suggestions;
+	arenaInit(&suggestions, arenaMem, arenaSize);
+	for (int x = 0; x < numPassSuggestions; x++)
+	{
+		if (arenaPassword(&suggestions, ctx, &plainPass[x], &spacedPass[x]) != 0) {
+			fprintf(stderr,"ERROR: %s\n",sugError(ctx));
+			exit(EXIT_FAILURE);
+		}
+	}
+	const char *lengthLabel = ((ctx->markov || ctx->dict->wordLen) && !policy.requireDigit && !policy.requireSymbol) ?
+		"- Password character length will be:" : "- Password character length up to:";
+	const char *wordsLabel = ctx->markov ?
+		"- Number of syllables per password:" : "- Number of words per suggested password:";
+
+#ifdef SUGPASS_HEADLESS
+	// HEADLESS BUILD: the same information as plain text on stdout
+	printf("Suggest Password Program\n%s\n\n", version);
+	printf("Application Stats:\n");
+	printf(" %-43s%u\n", "- Number of words available:", sugDictSize(ctx));
+	printf(" %-43s%d\n", wordsLabel, wordsRequired);
+	printf(" %-43s%zu\n", lengthLabel, sugMaxLength(ctx));
+	printf(" %-43s%d\n", "- Number of password suggesions to offer:", numPassSuggestions);
+	printf(" %-43s%.1f\n", "- Password entropy (bits):", sugEntropy(ctx));
+	printf("\n   Suggested passwords are:\n\n");
+	int spacedCol = 13 + (int)sugMaxLength(ctx);
+	printf("            %-*s%s\n", spacedCol, "Password:", "Password (with spaces):");
+	for (int x = 0; x < numPassSuggestions; x++)
+	{
+		printf("            %-*s%s\n", spacedCol, plainPass[x], spacedPass[x]);
+	}
+#else
+	// RUN AS NCURSES PROGRAM FROM HERE:
+	// startup a ncurses window to display output
+	initscr();
+	// display some info about the program
+	centerText(2,"Suggest Password Program");
+	centerText(3,version);
+
+	mvprintw(6,1, "Application Stats:");
+	mvprintw(7,2, "- Number of words available:");
+	mvprintw(7,45,"%u", sugDictSize(ctx));
+	mvprintw(8,2, "%s", wordsLabel);
+	mvprintw(8,45,"%d",wordsRequired);
+	mvprintw(9,2, "%s", lengthLabel);
+	mvprintw(9,45, "%zu", sugMaxLength(ctx));
+	mvprintw(10,2, "- Number of password suggesions to offer:");
+	mvprintw(10,45, "%d", numPassSuggestions);
+	mvprintw(11,2, "- Password entropy (bits):");
+	mvprintw(11,45, "%.1f", sugEntropy(ctx));
+	refresh();
+
+	
+	// mvprintw((LINES-2),1, "ROW: %d | COL: %d | TYPED: %d",row,col,typed);
+	// show the password suggestions
+	mvprintw(12,4, "Suggested passwords are:");
+	mvprintw(14,12, "Password:");
+	int spacedCol = 25 + (int)sugMaxLength(ctx);
+	mvprintw(14,spacedCol, "Password (with spaces):");
+	for (int x = 1; x <= numPassSuggestions; x++)
+	{
+		mvprintw(15+x,12,"%s", plainPass[x-1]);
+		mvprintw(15+x,spacedCol,"%s", spacedPass[x-1]);
+	}
 
 	endPause();
 	// shut down ncurses
 	endwin();
+#endif
+	// finished with the suggestions now - so free memory up
+	free(plainPass); free(spacedPass);
+	free(arenaMem); arenaMem = NULL;
+	sugFree(ctx); ctx = NULL;
 	
 	return EXIT_SUCCESS;
 